@@ -1,134 +1,198 @@
 #include <iostream>
-#include <intrin.h>
 #include <algorithm>
 
 #include "bitboard.h"
 #include "utils/defs.h"
 
-Bitboard OccupiedBB[3][7];
-Bitboard KnightAttacks[SQUARE_NB], KingAttacks[SQUARE_NB], PawnAttacksEast[2][SQUARE_NB], PawnAttacksWest[2][SQUARE_NB];
-Bitboard SetMask[64], ClearMask[64];
+// The functions below compute the lookup tables. They are constexpr, so the
+// tables are constant initialized: the compiler fills them and they are
+// stored in the binary, with no work left for startup.
 
-void init_pawn_attacks() {
-	for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-		File f = file_of(s);
+constexpr Array<Bitboard, SQUARE_NB> make_square_bb(bool clear) {
+	Array<Bitboard, SQUARE_NB> t = {};
 
-		if (f == FILE_A) {
-			if (is_ok(s + NORTH_EAST))
-				PawnAttacksEast[WHITE][s] = SquareBB[s + NORTH_EAST];
+	for (Square s = SQ_A1; s <= SQ_H8; ++s)
+		t[s] = clear ? ~(1ULL << s) : 1ULL << s;
 
-			if (is_ok(s + SOUTH_EAST))
-				PawnAttacksEast[BLACK][s] = SquareBB[s + SOUTH_EAST];
+	return t;
+}
 
-		} else if (f == FILE_H) {
-			if (is_ok(s + NORTH_WEST))
-				PawnAttacksWest[WHITE][s] = SquareBB[s + NORTH_WEST];
+constexpr Array<Array<int, SQUARE_NB>, SQUARE_NB> make_square_distance() {
+	Array<Array<int, SQUARE_NB>, SQUARE_NB> t = {};
 
-			if (is_ok(s + SOUTH_WEST))
-				PawnAttacksWest[BLACK][s] = SquareBB[s + SOUTH_WEST];
+	for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
+		for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2) {
+			int df = file_of(s1) - file_of(s2), dr = rank_of(s1) - rank_of(s2);
+			df = df < 0 ? -df : df;
+			dr = dr < 0 ? -dr : dr;
+			t[s1][s2] = df > dr ? df : dr;
+		}
 
-		} else {
-			if (is_ok(s + NORTH_EAST))
-				PawnAttacksEast[WHITE][s] = SquareBB[s + NORTH_EAST];
+	return t;
+}
 
-			if (is_ok(s + NORTH_WEST))
-				PawnAttacksWest[WHITE][s] = SquareBB[s + NORTH_WEST];
+constexpr Array<Bitboard, FILE_NB> make_file_bb(bool adjacent) {
+	Array<Bitboard, FILE_NB> t = {};
 
-			if (is_ok(s + SOUTH_EAST))
-				PawnAttacksEast[BLACK][s] = SquareBB[s + SOUTH_EAST];
+	for (File f = FILE_A; f <= FILE_H; ++f)
+		t[f] = adjacent ? (f > FILE_A ? FileABB << (f - 1) : 0) | (f < FILE_H ? FileABB << (f + 1) : 0)
+						: FileABB << f;
 
-			if (is_ok(s + SOUTH_WEST))
-				PawnAttacksWest[BLACK][s] = SquareBB[s + SOUTH_WEST];
-		}
-	}
+	return t;
 }
 
-void init_knight_attacks() {
-	int jumps[8] = { -6, -10, -15, -17, 6, 10, 15, 17 };
+constexpr Array<Bitboard, RANK_NB> make_rank_bb() {
+	Array<Bitboard, RANK_NB> t = {};
 
-	for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-		Bitboard attacks = 0;
-
-		for (int jump : jumps) {
-			Square to = s + Direction(jump);
+	for (Rank r = RANK_1; r <= RANK_8; ++r)
+		t[r] = Rank1BB << (8 * r);
 
-			if (is_ok(to) && SquareDistance[s][to] < 3) {
-				attacks |= SquareBB[to];
-			}
-		}
+	return t;
+}
 
-		KnightAttacks[s] = attacks;
-	}
+// forward_ranks() returns the ranks in front of r, from the point of view of c
+constexpr Bitboard forward_ranks(Color c, Rank r) {
+	return c == WHITE ? (r == RANK_8 ? 0 : ~Bitboard(0) << (8 * (r + 1)))
+					  : (1ULL << (8 * r)) - 1;
 }
 
-void init_king_attacks() {
-	for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-		Bitboard attacks = 0;
-		File f = file_of(s);
-		Rank r = rank_of(s);
+constexpr Array<Array<Bitboard, RANK_NB>, COLOR_NB> make_forward_ranks_bb() {
+	Array<Array<Bitboard, RANK_NB>, COLOR_NB> t = {};
 
-		if (is_ok(s + NORTH))
-			attacks = SquareBB[s + NORTH];
+	for (Color c = WHITE; c <= BLACK; ++c)
+		for (Rank r = RANK_1; r <= RANK_8; ++r)
+			t[c][r] = forward_ranks(c, r);
+
+	return t;
+}
 
-		if (is_ok(s + SOUTH))
-			attacks |= SquareBB[s + SOUTH];
+// make_pawn_masks() computes the squares in front of a pawn, on its own file,
+// on the adjacent files, or both.
+constexpr Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> make_pawn_masks(bool ownFile, bool adjacentFiles) {
+	Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> t = {};
+	Array<Bitboard, FILE_NB> adjacent = make_file_bb(true);
 
-		if (is_ok(s + EAST) && SquareDistance[s][s + EAST] == 1)
-			attacks |= SquareBB[s + EAST];
+	for (Color c = WHITE; c <= BLACK; ++c)
+		for (Square s = SQ_A1; s <= SQ_H8; ++s)
+			t[c][s] = forward_ranks(c, rank_of(s)) & (  (ownFile ? FileABB << file_of(s) : 0)
+													  | (adjacentFiles ? adjacent[file_of(s)] : 0));
 
-		if (is_ok(s + WEST) && SquareDistance[s][s + WEST] == 1)
-			attacks |= SquareBB[s + WEST];
+	return t;
+}
 
-		if (is_ok(s + NORTH_EAST) && SquareDistance[s][s + NORTH_EAST] == 1)
-			attacks |= SquareBB[s + NORTH_EAST];
+constexpr Array<Bitboard, SQUARE_NB> make_pseudo_attacks(PieceType pt) {
+	Array<Bitboard, SQUARE_NB> t = {};
 
-		if (is_ok(s + NORTH_WEST) && SquareDistance[s][s + NORTH_WEST] == 1)
-			attacks |= SquareBB[s + NORTH_WEST];
+	for (Square s = SQ_A1; s <= SQ_H8; ++s)
+		t[s] = pseudo_attacks(pt, s);
 
-		if (is_ok(s + SOUTH_EAST) && SquareDistance[s][s + SOUTH_EAST] == 1)
-			attacks |= SquareBB[s + SOUTH_EAST];
+	return t;
+}
 
-		if (is_ok(s + SOUTH_WEST) && SquareDistance[s][s + SOUTH_WEST] == 1)
-			attacks |= SquareBB[s + SOUTH_WEST];
+// make_pawn_attacks() computes the pawn attacks towards the H file (df = 1)
+// or the A file (df = -1).
+constexpr Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> make_pawn_attacks(int df) {
+	Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> t = {};
 
-		KingAttacks[s] = attacks;
+	for (Square s = SQ_A1; s <= SQ_H8; ++s) {
+		t[WHITE][s] = step_bb(s, df, 1);
+		t[BLACK][s] = step_bb(s, df, -1);
 	}
+
+	return t;
 }
 
-Bitboard sliding_attack(Direction directions[], Square sq, Bitboard occupied) {
-	Bitboard attack = 0;
+// make_line_bb() computes, for two squares on a common rank, file or diagonal,
+// either the full line through them or the squares between them.
+constexpr Array<Array<Bitboard, SQUARE_NB>, SQUARE_NB> make_line_bb(bool between) {
+	Array<Array<Bitboard, SQUARE_NB>, SQUARE_NB> t = {};
 
-	for (int i = 0; i < 4; ++i)
-		for (Square s = sq + directions[i];
-			is_ok(s) && distance(s, s - directions[i]) == 1;
-			s += directions[i])
-	{
-		attack |= s;
+	for (PieceType pt = BISHOP; pt <= ROOK; ++pt) {
+		Array<Bitboard, SQUARE_NB> attacks = make_pseudo_attacks(pt);
 
-		if (occupied & s)
-			break;
+		for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
+			for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
+				if (attacks[s1] & (1ULL << s2))
+					t[s1][s2] = between ? sliding_attack(pt, s1, 1ULL << s2) & sliding_attack(pt, s2, 1ULL << s1)
+										: (attacks[s1] & attacks[s2]) | (1ULL << s1) | (1ULL << s2);
 	}
 
-	return attack;
+	return t;
 }
 
+constexpr Array<Bitboard, SQUARE_NB> SetMask = make_square_bb(false);
+constexpr Array<Bitboard, SQUARE_NB> ClearMask = make_square_bb(true);
+constexpr Array<Bitboard, SQUARE_NB> KnightAttacks = make_pseudo_attacks(KNIGHT);
+constexpr Array<Bitboard, SQUARE_NB> KingAttacks = make_pseudo_attacks(KING);
+constexpr Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttacksEast = make_pawn_attacks(1);
+constexpr Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttacksWest = make_pawn_attacks(-1);
+
+constexpr Array<Array<int, SQUARE_NB>, SQUARE_NB> SquareDistance = make_square_distance();
+constexpr Array<Array<Bitboard, SQUARE_NB>, SQUARE_NB> BetweenBB = make_line_bb(true);
+constexpr Array<Array<Bitboard, SQUARE_NB>, SQUARE_NB> LineBB = make_line_bb(false);
+constexpr Array<Bitboard, SQUARE_NB> SquareBB = make_square_bb(false);
+constexpr Array<Bitboard, FILE_NB> FileBB = make_file_bb(false);
+constexpr Array<Bitboard, RANK_NB> RankBB = make_rank_bb();
+constexpr Array<Bitboard, FILE_NB> AdjacentFilesBB = make_file_bb(true);
+constexpr Array<Array<Bitboard, RANK_NB>, COLOR_NB> ForwardRanksBB = make_forward_ranks_bb();
+constexpr Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> ForwardFileBB = make_pawn_masks(true, false);
+constexpr Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttackSpan = make_pawn_masks(false, true);
+constexpr Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> PassedPawnMask = make_pawn_masks(true, true);
+
+// Magic numbers of the rook and bishop squares, found with a xorshift64star
+// search over sparse random numbers. A magic maps every relevant occupancy of
+// its square to an index of the attack it leads to.
+constexpr Bitboard RookMagicNumbers[SQUARE_NB] = {
+	0x0A80004000801220ULL, 0x8040004010002008ULL, 0x2080200010008008ULL, 0x1100100008210004ULL,
+	0xC200209084020008ULL, 0x2100010004000208ULL, 0x0400081000822421ULL, 0x0200010422048844ULL,
+	0x0800800080400024ULL, 0x0001402000401000ULL, 0x3000801000802001ULL, 0x4400800800100083ULL,
+	0x0904802402480080ULL, 0x4040800400020080ULL, 0x0018808042000100ULL, 0x4040800080004100ULL,
+	0x0040048001458024ULL, 0x00A0004000205000ULL, 0x3100808010002000ULL, 0x4825010010000820ULL,
+	0x5004808008000401ULL, 0x2024818004000A00ULL, 0x0005808002000100ULL, 0x2100060004806104ULL,
+	0x0080400880008421ULL, 0x4062220600410280ULL, 0x010A004A00108022ULL, 0x0000100080080080ULL,
+	0x0021000500080010ULL, 0x0044000202001008ULL, 0x0000100400080102ULL, 0xC020128200040545ULL,
+	0x0080002000400040ULL, 0x0000804000802004ULL, 0x0000120022004080ULL, 0x010A386103001001ULL,
+	0x9010080080800400ULL, 0x8440020080800400ULL, 0x0004228824001001ULL, 0x000000490A000084ULL,
+	0x0080002000504000ULL, 0x200020005000C000ULL, 0x0012088020420010ULL, 0x0010010080080800ULL,
+	0x0085001008010004ULL, 0x0002000204008080ULL, 0x0040413002040008ULL, 0x0000304081020004ULL,
+	0x0080204000800080ULL, 0x3008804000290100ULL, 0x1010100080200080ULL, 0x2008100208028080ULL,
+	0x5000850800910100ULL, 0x8402019004680200ULL, 0x0120911028020400ULL, 0x0000008044010200ULL,
+	0x0020850200244012ULL, 0x0020850200244012ULL, 0x0000102001040841ULL, 0x140900040A100021ULL,
+	0x000200282410A102ULL, 0x000200282410A102ULL, 0x000200282410A102ULL, 0x4048240043802106ULL
+};
+
+constexpr Bitboard BishopMagicNumbers[SQUARE_NB] = {
+	0x40106000A1160020ULL, 0x0020010250810120ULL, 0x2010010220280081ULL, 0x002806004050C040ULL,
+	0x0002021018000000ULL, 0x2001112010000400ULL, 0x0881010120218080ULL, 0x1030820110010500ULL,
+	0x0000120222042400ULL, 0x2000020404040044ULL, 0x8000480094208000ULL, 0x0003422A02000001ULL,
+	0x000A220210100040ULL, 0x8004820202226000ULL, 0x0018234854100800ULL, 0x0100004042101040ULL,
+	0x0004001004082820ULL, 0x0010000810010048ULL, 0x1014004208081300ULL, 0x2080818802044202ULL,
+	0x0040880C00A00100ULL, 0x0080400200522010ULL, 0x0001000188180B04ULL, 0x0080249202020204ULL,
+	0x1004400004100410ULL, 0x00013100A0022206ULL, 0x2148500001040080ULL, 0x4241080011004300ULL,
+	0x4020848004002000ULL, 0x10101380D1004100ULL, 0x0008004422020284ULL, 0x01010A1041008080ULL,
+	0x0808080400082121ULL, 0x0808080400082121ULL, 0x0091128200100C00ULL, 0x0202200802010104ULL,
+	0x8C0A020200440085ULL, 0x01A0008080B10040ULL, 0x0889520080122800ULL, 0x100902022202010AULL,
+	0x04081A0816002000ULL, 0x0000681208005000ULL, 0x8170840041008802ULL, 0x0A00004200810805ULL,
+	0x0830404408210100ULL, 0x2602208106006102ULL, 0x1048300680802628ULL, 0x2602208106006102ULL,
+	0x0602010120110040ULL, 0x0941010801043000ULL, 0x000040440A210428ULL, 0x0008240020880021ULL,
+	0x0400002012048200ULL, 0x00AC102001210220ULL, 0x0220021002009900ULL, 0x84440C080A013080ULL,
+	0x0001008044200440ULL, 0x0004C04410841000ULL, 0x2000500104011130ULL, 0x1A0C010011C20229ULL,
+	0x0044800112202200ULL, 0x0434804908100424ULL, 0x0300404822C08200ULL, 0x48081010008A2A80ULL
+};
+
 // init_magics() computes all rook and bishop attacks at startup. Magic
 // bitboards are used to look up attacks of sliding pieces. As a reference see
 // chessprogramming.wikispaces.com/Magic+Bitboards. In particular, here we
-// use the so called "fancy" approach.
-void init_magics(Bitboard table[], Magic magics[], Direction directions[]) {
-
-	// Optimal PRNG seeds to pick the correct magics in the shortest time
-	int seeds[][RANK_NB] = { { 8977, 44560, 54343, 38998,  5731, 95205, 104912, 17020 },
-	{ 728, 10316, 55013, 32803, 12281, 15100,  16645,   255 } };
-
-	Bitboard occupancy[4096], reference[4096], edges, b;
-	int epoch[4096] = {}, cnt = 0, size = 0;
+// use the so called "fancy" approach. Without a fast PEXT the index is a
+// multiplication by one of the magic numbers above. With a fast PEXT the
+// compact tables are filled too.
+void init_magics(PieceType pt, Bitboard table[], uint16_t compact[], Magic magics[], const Bitboard magicNumbers[]) {
+	int size = 0;
 
 	for (Square s = SQ_A1; s <= SQ_H8; ++s)
 	{
 		// Board edges are not considered in the relevant occupancies
-		edges = ((Rank1BB | Rank8BB) & ~rank_bb(s)) | ((FileABB | FileHBB) & ~file_bb(s));
+		Bitboard edges = ((Rank1BB | Rank8BB) & ~rank_bb(s)) | ((FileABB | FileHBB) & ~file_bb(s));
 
 		// Given a square 's', the mask is the bitboard of sliding attacks from
 		// 's' computed on an empty board. The index must be big enough to contain
@@ -136,20 +200,29 @@ void init_magics(Bitboard table[], Magic magics[], Direction directions[]) {
 		// the number of 1s of the mask. Hence we deduce the size of the shift to
 		// apply to the 64 or 32 bits word to get the index.
 		Magic& m = magics[s];
-		m.mask = sliding_attack(directions, s, 0) & ~edges;
+		m.rays = sliding_attack(pt, s, 0);
+		m.mask = m.rays & ~edges;
+		m.magic = magicNumbers[s];
+		m.shift = 64 - popcount(m.mask);
 
 		// Set the offset for the attacks table of the square. We have individual
 		// table sizes for each square with "Fancy Magic Bitboards".
 		m.attacks = s == SQ_A1 ? table : magics[s - 1].attacks + size;
+		m.compact = s == SQ_A1 ? compact : magics[s - 1].compact + size;
 
 		// Use Carry-Rippler trick to enumerate all subsets of masks[s] and
-		// store the corresponding sliding attack bitboard in reference[].
-		b = size = 0;
+		// store the corresponding sliding attack bitboard in the table.
+		Bitboard b = size = 0;
 		do {
-			occupancy[size] = b;
-			reference[size] = sliding_attack(directions, s, b);
+			Bitboard attack = sliding_attack(pt, s, b);
+
+			// Occupancies may only share an index if they lead to the same attack
+			assert(!m.attacks[m.index(b)] || m.attacks[m.index(b)] == attack);
+
+			m.attacks[m.index(b)] = attack;
 
-			m.attacks[_pext_u64(b, m.mask)] = reference[size];
+			if (CPU::HasFastPext)
+				m.compact[m.index(b)] = uint16_t(pext(attack, m.rays));
 
 			size++;
 			b = (b - m.mask) & m.mask;
@@ -157,66 +230,25 @@ void init_magics(Bitboard table[], Magic magics[], Direction directions[]) {
 	}
 }
 
-int SquareDistance[SQUARE_NB][SQUARE_NB];
-Bitboard SquareBB[SQUARE_NB];
-Bitboard FileBB[FILE_NB];
-Bitboard RankBB[RANK_NB];
-
 Magic RookMagics[SQUARE_NB];
 Magic BishopMagics[SQUARE_NB];
 
 namespace BB {
 	Bitboard RookTable[0x19000];  // To store rook attacks
 	Bitboard BishopTable[0x1480]; // To store bishop attacks
+	uint16_t RookCompact[0x19000];  // Rook attacks as subsets of the rays
+	uint16_t BishopCompact[0x1480]; // Bishop attacks as subsets of the rays
 
-	void init() {
-		for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
-			for (Square s2 = SQ_A1; s2 <= SQ_H8; ++s2)
-				if (s1 != s2) SquareDistance[s1][s2] = std::max(distance<File>(s1, s2), distance<Rank>(s1, s2));
-
-		for (Color c = WHITE; c <= BOTH; ++c)
-			for (PieceType p = PIECETYPE_ANY; p <= KING; ++p)
-				OccupiedBB[c][p] = 0;
-
-		for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-			SquareBB[s] = (1ULL << s);
-			SetMask[s] = (1ULL << s);
-			ClearMask[s] = ~SetMask[s];
-		}
-
-		for (File f = FILE_A; f <= FILE_H; ++f)
-			FileBB[f] = f > FILE_A ? FileBB[f - 1] << 1 : FileABB;
+	bool CompactAttacks = false;
 
-		for (Rank r = RANK_1; r <= RANK_8; ++r)
-			RankBB[r] = r > RANK_1 ? RankBB[r - 1] << 8 : Rank1BB;
-
-		Direction RookDirections[] = { NORTH, EAST, SOUTH, WEST };
-		Direction BishopDirections[] = { NORTH_EAST, SOUTH_EAST, SOUTH_WEST, NORTH_WEST };
-
-		init_pawn_attacks();
-		init_knight_attacks();
-		init_king_attacks();
-		init_magics(RookTable, RookMagics, RookDirections);
-		init_magics(BishopTable, BishopMagics, BishopDirections);
+	void use_compact(bool on) {
+		CompactAttacks = on && CPU::HasFastPext;
 	}
-}
-
-Bitboard single_push_targets_white(Bitboard wpawns, Bitboard empty) {
-	return north_one(wpawns) & empty;
-}
-
-Bitboard double_push_targets_white(Bitboard wpawns, Bitboard empty) {
-	const Bitboard rank4 = 0x00000000FF000000;
-	Bitboard singlePushs = single_push_targets_white(wpawns, empty);
-	return north_one(singlePushs) & empty & rank4;
-}
-
-Bitboard single_push_targets_black(Bitboard bpawns, Bitboard empty) {
-	return south_one(bpawns) & empty;
-}
 
-Bitboard double_push_targets_black(Bitboard bpawns, Bitboard empty) {
-	const Bitboard rank5 = 0x000000FF00000000;
-	Bitboard singlePushs = single_push_targets_black(bpawns, empty);
-	return south_one(singlePushs) & empty & rank5;
-}
+	// init() fills the slider attack tables. They depend on the PEXT support
+	// of the processor, so they cannot be computed by the compiler.
+	void init() {
+		init_magics(ROOK, RookTable, RookCompact, RookMagics, RookMagicNumbers);
+		init_magics(BISHOP, BishopTable, BishopCompact, BishopMagics, BishopMagicNumbers);
+	}
+}
\ No newline at end of file
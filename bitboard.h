@@ -4,20 +4,46 @@
 #include <vector>
 #include "utils/defs.h"
 
-// Magic holds all magic bitboards relevant data for a single square
+namespace BB {
+
+	// CompactAttacks is true when slider attacks are looked up in the compact
+	// tables, set with the "Compact Attacks" option. It needs a fast PEXT.
+	extern bool CompactAttacks;
+
+	void init();
+	void use_compact(bool on);
+}
+
+// Magic holds all magic bitboards relevant data for a single square. Besides
+// the full attack bitboards, indexed by PEXT or by a magic multiplication,
+// attacks are also stored in 16 bits, as the subset of the rays from the
+// square on an empty board, and expanded back with PDEP. The compact tables
+// take a quarter of the space, so that more of them stays in the caches.
 struct Magic {
 	Bitboard  mask;
+	Bitboard  magic;
+	Bitboard  rays;
 	Bitboard* attacks;
+	uint16_t* compact;
+	unsigned  shift;
 
-	// Compute the attack's index using the 'magic bitboards' approach
+	// Compute the attack's index with PEXT where it is fast, otherwise using
+	// the 'magic bitboards' approach. The branch always goes the same way, so
+	// it is predicted for free.
 	unsigned index(Bitboard occ) const {
-		return unsigned(pext(occ, mask));
+		if (CPU::HasFastPext)
+			return pext(occ, mask);
+
+		return unsigned(((occ & mask) * magic) >> shift);
 	}
-};
 
-namespace BB {
-	void init();
-}
+	Bitboard attacks_bb(Bitboard occ) const {
+		if (BB::CompactAttacks)
+			return pdep(compact[pext(occ, mask)], rays);
+
+		return attacks[index(occ)];
+	}
+};
 
 // shift() moves a bitboard one step along direction D (mainly for pawns)
 template<Direction D>
@@ -62,19 +88,73 @@ constexpr Bitboard Rank6BB = Rank1BB << (8 * 5);
 constexpr Bitboard Rank7BB = Rank1BB << (8 * 6);
 constexpr Bitboard Rank8BB = Rank1BB << (8 * 7);
 
-extern Bitboard OccupiedBB[3][7]; // BB[color][piecetype]
-extern Bitboard KnightAttacks[SQUARE_NB], KingAttacks[SQUARE_NB], PawnAttacksEast[2][SQUARE_NB], PawnAttacksWest[2][SQUARE_NB]; // [color][sq]
+// step_bb() returns the square at the given file and rank offsets from s, or
+// an empty bitboard if that is off the board.
+constexpr Bitboard step_bb(Square s, int df, int dr) {
+	return   file_of(s) + df >= FILE_A && file_of(s) + df <= FILE_H
+		  && rank_of(s) + dr >= RANK_1 && rank_of(s) + dr <= RANK_8 ? 1ULL << (s + df + 8 * dr) : 0;
+}
+
+// sliding_attack() returns the squares a bishop or a rook on s attacks, each
+// ray stopping at the first occupied square.
+constexpr Bitboard sliding_attack(PieceType pt, Square s, Bitboard occupied) {
+	const int directions[2][4][2] = { { { 1, 1 }, { 1, -1 }, { -1, -1 }, { -1, 1 } },
+									  { { 0, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 } } };
+	Bitboard attack = 0;
+
+	for (const auto& d : directions[pt == ROOK])
+		for (int i = 1; ; ++i) {
+			Bitboard b = step_bb(s, i * d[0], i * d[1]);
+			attack |= b;
+
+			if (!b || (occupied & b))
+				break;
+		}
 
-extern int SquareDistance[SQUARE_NB][SQUARE_NB];
-extern Bitboard SquareBB[SQUARE_NB];
-extern Bitboard FileBB[FILE_NB];
-extern Bitboard RankBB[RANK_NB];
+	return attack;
+}
+
+// pseudo_attacks() returns the attacks of a piece other than a pawn on an
+// empty board.
+constexpr Bitboard pseudo_attacks(PieceType pt, Square s) {
+	const int knightSteps[8][2] = { { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 }, { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 } };
+	const int kingSteps[8][2] = { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 1, -1 }, { 0, -1 }, { -1, -1 }, { -1, 0 }, { -1, 1 } };
+	Bitboard attack = 0;
+
+	if (pt == KNIGHT || pt == KING)
+		for (const auto& d : pt == KNIGHT ? knightSteps : kingSteps)
+			attack |= step_bb(s, d[0], d[1]);
+	else {
+		if (pt != ROOK)
+			attack |= sliding_attack(BISHOP, s, 0);
+		if (pt != BISHOP)
+			attack |= sliding_attack(ROOK, s, 0);
+	}
+
+	return attack;
+}
+
+// Lookup tables, computed at compile time in bitboard.cpp
+extern const Array<Bitboard, SQUARE_NB> KnightAttacks, KingAttacks;
+extern const Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttacksEast, PawnAttacksWest; // [color][sq]
+
+extern const Array<Array<int, SQUARE_NB>, SQUARE_NB> SquareDistance;
+extern const Array<Array<Bitboard, SQUARE_NB>, SQUARE_NB> BetweenBB;
+extern const Array<Array<Bitboard, SQUARE_NB>, SQUARE_NB> LineBB;
+extern const Array<Bitboard, SQUARE_NB> SquareBB;
+extern const Array<Bitboard, FILE_NB> FileBB;
+extern const Array<Bitboard, RANK_NB> RankBB;
+extern const Array<Bitboard, FILE_NB> AdjacentFilesBB;
+extern const Array<Array<Bitboard, RANK_NB>, COLOR_NB> ForwardRanksBB;
+extern const Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> ForwardFileBB;
+extern const Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> PawnAttackSpan;
+extern const Array<Array<Bitboard, SQUARE_NB>, COLOR_NB> PassedPawnMask;
 
 template<PieceType Pt>
 inline Bitboard attacks_bb(Square s, Bitboard occ) {
 	assert(Pt != PAWN);
 	const Magic& m = Pt == ROOK ? RookMagics[s] : BishopMagics[s];
-	return m.attacks[m.index(occ)];
+	return m.attacks_bb(occ);
 }
 
 inline Bitboard attacks_bb(PieceType pt, Square s, Bitboard occ) {
@@ -94,13 +174,7 @@ inline Bitboard south_one(Bitboard bb) { return  bb >> 8; }
 inline Bitboard east_one(Bitboard bb) { return (bb << 1) & NotAFile; }
 inline Bitboard west_one(Bitboard bb) { return (bb >> 1) & NotHFile; }
 
-Bitboard single_push_targets_white(Bitboard wpawns, Bitboard empty);
-Bitboard double_push_targets_white(Bitboard wpawns, Bitboard empty);
-Bitboard single_push_targets_black(Bitboard bpawns, Bitboard empty);
-Bitboard double_push_targets_black(Bitboard bpawns, Bitboard empty);
-
-extern Bitboard SetMask[64];
-extern Bitboard ClearMask[64];
+extern const Array<Bitboard, SQUARE_NB> SetMask, ClearMask;
 
 inline void set_bit(Bitboard& b, Square s) {
 	b |= SquareBB[s];
@@ -153,6 +227,67 @@ inline Bitboard file_bb(Square s) {
 	return FileBB[file_of(s)];
 }
 
+// adjacent_files_bb() returns a bitboard representing all the squares on the
+// adjacent files of the given one.
+inline Bitboard adjacent_files_bb(File f) {
+	return AdjacentFilesBB[f];
+}
+
+// forward_ranks_bb() returns a bitboard representing the squares on all the
+// ranks in front of the given one, from the point of view of the given color.
+// For instance, forward_ranks_bb(BLACK, SQ_D3) returns the 16 squares on
+// ranks 1 and 2.
+inline Bitboard forward_ranks_bb(Color c, Square s) {
+	return ForwardRanksBB[c][rank_of(s)];
+}
+
+// forward_file_bb() returns a bitboard representing all the squares along the
+// line in front of the given one, from the point of view of the given color.
+inline Bitboard forward_file_bb(Color c, Square s) {
+	return ForwardFileBB[c][s];
+}
+
+// pawn_attack_span() returns a bitboard representing all the squares that can
+// be attacked by a pawn of the given color when it moves along its file,
+// starting from the given square.
+inline Bitboard pawn_attack_span(Color c, Square s) {
+	return PawnAttackSpan[c][s];
+}
+
+// passed_pawn_mask() returns a bitboard mask which can be used to test if a
+// pawn of the given color and on the given square is a passed pawn.
+inline Bitboard passed_pawn_mask(Color c, Square s) {
+	return PassedPawnMask[c][s];
+}
+
+// frontmost_sq() and backmost_sq() return the most/least advanced square in
+// the given bitboard relative to the given color.
+inline Square frontmost_sq(Color c, Bitboard b) {
+	return c == WHITE ? msb(b) : lsb(b);
+}
+
+inline Square backmost_sq(Color c, Bitboard b) {
+	return c == WHITE ? lsb(b) : msb(b);
+}
+
+inline bool more_than_one(Bitboard b) {
+	return b & (b - 1);
+}
+
+// between_bb() returns a bitboard representing all the squares between the two
+// given ones. For instance, between_bb(SQ_C4, SQ_F7) returns a bitboard with
+// the bits for squares d5 and e6 set. If s1 and s2 are not on the same rank,
+// file or diagonal, 0 is returned.
+inline Bitboard between_bb(Square s1, Square s2) {
+	return BetweenBB[s1][s2];
+}
+
+// aligned() returns true if the squares s1, s2 and s3 are aligned either on a
+// straight or on a diagonal line.
+inline bool aligned(Square s1, Square s2, Square s3) {
+	return LineBB[s1][s2] & s3;
+}
+
 // distance() functions return the distance between x and y, defined as the
 // number of steps for a king in x to reach y. Works with squares, ranks, files.
 template<typename T> inline int distance(T x, T y) { return x < y ? y - x : x - y; }
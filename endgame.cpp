@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cstring>
+
+#include "endgame.h"
+#include "bitboard.h"
+#include "position.h"
+
+namespace Endgames {
+
+	// Table used to drive the king towards the edge of the board
+	// in KX vs K and KQ vs KR endgames.
+	constexpr int PushToEdges[SQUARE_NB] = {
+		100, 90, 80, 70, 70, 80, 90, 100,
+		 90, 70, 60, 50, 50, 60, 70,  90,
+		 80, 60, 40, 30, 30, 40, 60,  80,
+		 70, 50, 30, 20, 20, 30, 50,  70,
+		 70, 50, 30, 20, 20, 30, 50,  70,
+		 80, 60, 40, 30, 30, 40, 60,  80,
+		 90, 70, 60, 50, 50, 60, 70,  90,
+		100, 90, 80, 70, 70, 80, 90, 100
+	};
+
+	// Table used to drive the king towards a corner square of the
+	// right color in KBN vs K endgames.
+	constexpr int PushToCorners[SQUARE_NB] = {
+		200, 190, 180, 170, 160, 150, 140, 130,
+		190, 180, 170, 160, 150, 140, 130, 140,
+		180, 170, 155, 140, 140, 125, 140, 150,
+		170, 160, 140, 120, 110, 140, 150, 160,
+		160, 150, 140, 110, 120, 140, 160, 170,
+		150, 140, 125, 140, 140, 155, 170, 180,
+		140, 130, 140, 150, 160, 170, 180, 190,
+		130, 140, 150, 160, 170, 180, 190, 200
+	};
+
+	// Table used to drive the two kings close to each other, indexed by distance
+	constexpr int PushClose[8] = { 0, 0, 100, 80, 60, 40, 20, 10 };
+
+	// Registered endgames with their material keys, one entry per color
+	struct Entry {
+		Key key;
+		Endgame endgame;
+	};
+
+	static Entry Entries[8];
+	static int EntryCount = 0;
+
+	static bool opposite_colors(Square s1, Square s2) {
+		int s = int(s1) ^ int(s2);
+		return ((s >> 3) ^ s) & 1;
+	}
+
+	// lone_king_stalemated() tests whether the side to move has only a king,
+	// which is not in check and has no legal move.
+	static bool lone_king_stalemated(const Position& pos, Color weakSide) {
+		Square ksq = pos.king_sq(weakSide);
+
+		if (pos.side_to_move() != weakSide || pos.checkers())
+			return false;
+
+		Bitboard b = KingAttacks[ksq];
+		Bitboard occ = pos.pieces() ^ ksq;
+
+		while (b)
+			if (!(pos.attackers_to(pop_lsb(&b), occ) & pos.pieces(~weakSide)))
+				return false;
+
+		return true;
+	}
+
+	// Mate with KX vs K. This function is used to evaluate positions with
+	// king and plenty of material vs a lone king. It simply gives the
+	// attacking side a bonus for driving the defending king towards the edge
+	// of the board, and for keeping the distance between the two kings small.
+	static Value evaluate_kxk(const Position& pos, Color strongSide) {
+		Color weakSide = ~strongSide;
+		Square winnerKSq = pos.king_sq(strongSide);
+		Square loserKSq = pos.king_sq(weakSide);
+
+		if (lone_king_stalemated(pos, weakSide))
+			return VALUE_DRAW;
+
+		Value result = pos.non_pawn_material(strongSide)
+					 + popcount(pos.pieces(strongSide, PAWN)) * PawnValueEg
+					 + PushToEdges[loserKSq]
+					 + PushClose[distance(winnerKSq, loserKSq)];
+
+		Bitboard bishops = pos.pieces(strongSide, BISHOP);
+
+		if (   pos.pieces(strongSide, QUEEN)
+			|| pos.pieces(strongSide, ROOK)
+			|| (bishops && pos.pieces(strongSide, KNIGHT))
+			|| ((bishops & DarkSquares) && (bishops & ~DarkSquares)))
+			result = std::min(result + VALUE_KNOWN_WIN, VALUE_MATE_IN_MAX_PLY - 1);
+
+		return strongSide == pos.side_to_move() ? result : -result;
+	}
+
+	// Mate with KBN vs K. This is similar to KX vs K, but we have to drive the
+	// defending king towards a corner square that our bishop attacks.
+	static Value evaluate_kbnk(const Position& pos, Color strongSide) {
+		Square winnerKSq = pos.king_sq(strongSide);
+		Square loserKSq = pos.king_sq(~strongSide);
+		Square bishopSq = lsb(pos.pieces(strongSide, BISHOP));
+
+		// PushToCorners drives toward corners A1 or H8. If we have a bishop that
+		// cannot reach them, flip the kings to drive toward corners A8 or H1.
+		if (opposite_colors(bishopSq, SQ_A1)) {
+			winnerKSq = ~winnerKSq;
+			loserKSq = ~loserKSq;
+		}
+
+		Value result = VALUE_KNOWN_WIN
+					 + PushClose[distance(winnerKSq, loserKSq)]
+					 + PushToCorners[loserKSq];
+
+		return strongSide == pos.side_to_move() ? result : -result;
+	}
+
+	// KR vs KP. This is a somewhat tricky endgame to evaluate precisely without
+	// a bitbase. The function below returns drawish scores when the pawn is
+	// far advanced with support of the king, while the attacking king is far
+	// away.
+	static Value evaluate_krkp(const Position& pos, Color strongSide) {
+		Color weakSide = ~strongSide;
+		Square wksq = relative_square(strongSide, pos.king_sq(strongSide));
+		Square bksq = relative_square(strongSide, pos.king_sq(weakSide));
+		Square rsq = relative_square(strongSide, lsb(pos.pieces(strongSide, ROOK)));
+		Square psq = relative_square(strongSide, lsb(pos.pieces(weakSide, PAWN)));
+		Square queeningSq = make_square(file_of(psq), RANK_1);
+		Value result;
+
+		// If the stronger side's king is in front of the pawn, it's a win
+		if (forward_file_bb(WHITE, wksq) & psq)
+			result = RookValueEg - distance(wksq, psq);
+
+		// If the weaker side's king is too far from the pawn and the rook,
+		// it's a win.
+		else if (   distance(bksq, psq) >= 3 + (pos.side_to_move() == weakSide)
+				 && distance(bksq, rsq) >= 3)
+			result = RookValueEg - distance(wksq, psq);
+
+		// If the pawn is far advanced and supported by the defending king,
+		// the position is drawish
+		else if (   rank_of(bksq) <= RANK_3
+				 && distance(bksq, psq) == 1
+				 && rank_of(wksq) >= RANK_4
+				 && distance(wksq, psq) > 2 + (pos.side_to_move() == strongSide))
+			result = Value(80) - 8 * distance(wksq, psq);
+
+		else
+			result = Value(200) - 8 * (  distance(wksq, psq + SOUTH)
+									   - distance(bksq, psq + SOUTH)
+									   - distance(psq, queeningSq));
+
+		return strongSide == pos.side_to_move() ? result : -result;
+	}
+
+	// KQ vs KR. This is almost identical to KX vs K: we give the attacking
+	// king a bonus for having the kings close together, and for forcing the
+	// defending king towards the edge. If we also take care to avoid null move
+	// for the defending side in the search, this is usually sufficient to win
+	// KQ vs KR.
+	static Value evaluate_kqkr(const Position& pos, Color strongSide) {
+		Square winnerKSq = pos.king_sq(strongSide);
+		Square loserKSq = pos.king_sq(~strongSide);
+
+		Value result = QueenValueEg - RookValueEg
+					 + PushToEdges[loserKSq]
+					 + PushClose[distance(winnerKSq, loserKSq)];
+
+		return strongSide == pos.side_to_move() ? result : -result;
+	}
+
+	// Some cases of trivial draws
+	static Value evaluate_knnk(const Position&, Color) {
+		return VALUE_DRAW;
+	}
+
+	const Endgame KXK[COLOR_NB] = { { evaluate_kxk, WHITE }, { evaluate_kxk, BLACK } };
+
+	// add() registers an endgame given by a code like "KBNK", strong side
+	// first, for both colors. The material key is computed from the piece
+	// counts of the code, so that no position needs to be set up.
+	static void add(const char* code, EndgameFn fn) {
+		for (Color c = WHITE; c <= BLACK; ++c) {
+			int counts[COLOR_NB][PIECETYPE_NB] = {};
+			Color side = c;
+
+			for (const char* p = code; *p; ++p) {
+				if (p != code && *p == 'K')
+					side = ~c;
+
+				counts[side][std::strchr(" PNBRQK", *p) - " PNBRQK"]++;
+			}
+
+			assert(EntryCount < 8);
+			Entries[EntryCount++] = { Zobrist::material_key(counts), { fn, c } };
+		}
+	}
+
+	void init() {
+		add("KNNK", evaluate_knnk);
+		add("KBNK", evaluate_kbnk);
+		add("KRKP", evaluate_krkp);
+		add("KQKR", evaluate_kqkr);
+	}
+
+	const Endgame* probe(Key materialKey) {
+		for (int i = 0; i < EntryCount; ++i)
+			if (Entries[i].key == materialKey)
+				return &Entries[i].endgame;
+
+		return nullptr;
+	}
+}
\ No newline at end of file
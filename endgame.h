@@ -0,0 +1,27 @@
+#pragma once
+
+#include "utils/defs.h"
+
+class Position;
+
+namespace Endgames {
+
+	typedef Value (*EndgameFn)(const Position& pos, Color strongSide);
+
+	// Endgame is a specialized evaluation function for one material
+	// configuration, bound to the side which has the extra material. It returns
+	// the score from the point of view of the side to move.
+	struct Endgame {
+		EndgameFn fn;
+		Color strongSide;
+
+		Value operator()(const Position& pos) const { return fn(pos, strongSide); }
+	};
+
+	// KXK is not bound to a material key, it is used for any lone king against
+	// enough material to mate.
+	extern const Endgame KXK[COLOR_NB];
+
+	void init();
+	const Endgame* probe(Key materialKey);
+}
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include "evaluate.h"
+#include "nnue.h"
 #include "utils/defs.h"
 
 namespace Evaluation {
@@ -136,71 +137,28 @@ namespace Evaluation {
 		{ Value(51), Value(38) }
 	};
 
-	// PassedRank[Rank] contains a bonus according to the rank of a passed pawn
-	constexpr Value PassedRank[RANK_NB][PHASE_NB] = {
-		{ Value(0),   Value(0)   },
-		{ Value(5),   Value(18)  },
-		{ Value(12),  Value(23)  },
-		{ Value(10),  Value(31)  },
-		{ Value(57),  Value(62)  },
-		{ Value(163), Value(167) },
-		{ Value(271), Value(250) }
-	};
-
-	// PassedFile[File] contains a bonus according to the file of a passed pawn
-	constexpr Value PassedFile[FILE_NB][PHASE_NB] = {
-		{ Value(-1),  Value(7)   },
-		{ Value(0),   Value(9)   },
-		{ Value(-9),  Value(-8)  },
-		{ Value(-30), Value(-14) },
-		{ Value(-30), Value(-14) },
-		{ Value(-9),  Value(-8)  },
-		{ Value(0),   Value(9)   },
-		{ Value(-1),  Value(7)   }
-	};
-
-	// kingRing[color] are the squares adjacent to the king, plus (only for a
-	// king on its first rank) the squares two ranks in front. For instance,
-	// if black's king is on g8, kingRing[BLACK] is f8, h8, f7, g7, h7, f6, g6
-	// and h6.
-	Bitboard kingRing[COLOR_NB];
-
-	// kingAttackersCount[color] is the number of pieces of the given color
-	// which attack a square in the kingRing of the enemy king.
-	int kingAttackersCount[COLOR_NB];
-
-	// kingAttackersWeight[color] is the sum of the "weights" of the pieces of
-	// the given color which attack a square in the kingRing of the enemy king.
-	// The weights of the individual piece types are given by the elements in
-	// the KingAttackWeights array.
-	int kingAttackersWeight[COLOR_NB];
-
-	Bitboard MobilityArea[COLOR_NB];
-	Value Mobility[COLOR_NB] = { VALUE_ZERO, VALUE_ZERO };
-
-	// Evaluation::initialize() computes king and pawn attacks, and the king ring
-	// bitboard for a given color. This is done at the beginning of the evaluation.
+	// Evaluation::initialize() computes the mobility area for a given color. This
+	// is done at the beginning of the evaluation.
 	template<Color Us>
-	void initialize() {
+	void initialize(const Position& pos, EvalInfo& ei) {
 		constexpr Color     Them = (Us == WHITE ? BLACK : WHITE);
 		constexpr Direction Up = (Us == WHITE ? NORTH : SOUTH);
 		constexpr Direction Down = (Us == WHITE ? SOUTH : NORTH);
 		constexpr Bitboard LowRanks = (Us == WHITE ? Rank2BB | Rank3BB : Rank7BB | Rank6BB);
 
 		// Find our pawns that are blocked or on the first two ranks
-		Bitboard b = OccupiedBB[Us][PAWN] & (shift<Down>(OccupiedBB[BOTH][PIECETYPE_ANY]) | LowRanks);
+		Bitboard b = pos.pieces(Us, PAWN) & (shift<Down>(pos.pieces()) | LowRanks);
 
 		// Squares occupied by those pawns, by our king or queen, or controlled by enemy pawns
 		// are excluded from the mobility area.
-		MobilityArea[Us] = ~(b | OccupiedBB[Us][KING] | OccupiedBB[Us][QUEEN] | pawn_attacks_bb<Them>(OccupiedBB[Them][PAWN]));
-		Mobility[Us] = VALUE_ZERO;
+		ei.mobilityArea[Us] = ~(b | pos.pieces(Us, KING) | pos.pieces(Us, QUEEN) | ei.pe->pawn_attacks(Them));
+		ei.mobility[Us][PHASE_MID] = ei.mobility[Us][PHASE_END] = VALUE_ZERO;
 	}
 
 	// Evaluation::pieces() scores pieces of a given color and type
 	template<Color Us, PieceType Pt>
-	Value pieces(const Position& pos, Phase ph) {
+	void pieces(const Position& pos, EvalInfo& ei) {
 		Bitboard bb = pos.pieces(Us, Pt);
-		Value value = VALUE_ZERO;
 		Square s;
 
 		while (bb) 
@@ -212,38 +170,73 @@ namespace Evaluation {
 							 : Pt == ROOK   ? attacks_bb<  ROOK>(s, pos.pieces() ^ pos.pieces(QUEEN) ^ pos.pieces(Us, ROOK))
 										    : pos.attacks_from<Pt>(s);
 
-			int mob = popcount(attacks & MobilityArea[Us]);
-			Mobility[Us] += MobilityBonus[Pt - 2][mob][ph];
+			int mob = popcount(attacks & ei.mobilityArea[Us]);
+			ei.mobility[Us][PHASE_MID] += MobilityBonus[Pt - 2][mob][PHASE_MID];
+			ei.mobility[Us][PHASE_END] += MobilityBonus[Pt - 2][mob][PHASE_END];
 		}
-		
-		return value;
+	}
+
+	// Evaluation::interpolate() blends the middlegame and endgame scores by the
+	// game phase. The endgame score is first scaled by the scale factor of the
+	// stronger side.
+	Value interpolate(const Value score[PHASE_NB], const Material::Entry* me) {
+		Color strongSide = score[PHASE_END] > VALUE_DRAW ? WHITE : BLACK;
+		int eg = score[PHASE_END] * me->scale_factor(strongSide) / SCALE_FACTOR_NORMAL;
+
+		return Value((score[PHASE_MID] * me->game_phase() + eg * (Material::PhaseMidgame - me->game_phase()))
+					 / Material::PhaseMidgame);
 	}
 
 	Value evaluate(const Position& pos) {
-		if (popcount(OccupiedBB[WHITE][KING]) == 0) return VALUE_MATE;
-		if (popcount(OccupiedBB[BLACK][KING]) == 0) return -VALUE_MATE;
+		EvalInfo ei;
+		return evaluate(pos, ei);
+	}
+
+	Value evaluate(const Position& pos, EvalInfo& ei) {
+		if (popcount(pos.pieces(WHITE, KING)) == 0) return VALUE_MATE;
+		if (popcount(pos.pieces(BLACK, KING)) == 0) return -VALUE_MATE;
 
 		Color us = pos.side_to_move();
-		Color them = ~us;
-		Value valueMg = pos.psq_score(PHASE_MID);
-		Value valueEg = pos.psq_score(PHASE_END);
-		Value value = (valueMg + valueEg) / 2;
-		Phase ph = pos.non_pawn_material() <= EndgameLimit ? PHASE_END : PHASE_MID;
+
+		// Probe the material hash table. Known endgames have their own
+		// evaluation function, and the game phase comes from the material.
+		ei.me = Material::probe(pos);
+
+		if (ei.me->specialized_eval_exists())
+			return ei.me->evaluate(pos);
+
+		// The network replaces the rest of the evaluation when it is enabled
+		if (NNUE::Enabled)
+			return NNUE::evaluate(pos) + Evaluation::Tempo;
+
+		// Probe the pawn hash table, the pawn structure rarely changes between
+		// nodes so this is usually a single lookup.
+		ei.pe = Pawns::probe(pos);
+
+		Value score[PHASE_NB];
+		for (Phase ph = PHASE_MID; ph <= PHASE_END; ++ph)
+			score[ph] = pos.psq_score(ph) + ei.me->imbalance()
+					  + ei.pe->pawn_score(WHITE, ph) - ei.pe->pawn_score(BLACK, ph);
 
 		// Early exit if score is high
+		Value value = interpolate(score, ei.me);
 		if (abs(value) > LazyThreshold)
 			return us == WHITE ? value : -value;
 
-		initialize<WHITE>();
-		initialize<BLACK>();
+		initialize<WHITE>(pos, ei);
+		initialize<BLACK>(pos, ei);
 		
 		// Pieces should be evaluated first (populate attack tables)
-		value += pieces<WHITE, KNIGHT>(pos, ph) - pieces<BLACK, KNIGHT>(pos, ph)
-			  +  pieces<WHITE, BISHOP>(pos, ph) - pieces<BLACK, BISHOP>(pos, ph)
-			  +  pieces<WHITE, ROOK  >(pos, ph) - pieces<BLACK, ROOK  >(pos, ph)
-			  +  pieces<WHITE, QUEEN >(pos, ph) - pieces<BLACK, QUEEN >(pos, ph);
+		pieces<WHITE, KNIGHT>(pos, ei); pieces<BLACK, KNIGHT>(pos, ei);
+		pieces<WHITE, BISHOP>(pos, ei); pieces<BLACK, BISHOP>(pos, ei);
+		pieces<WHITE, ROOK  >(pos, ei); pieces<BLACK, ROOK  >(pos, ei);
+		pieces<WHITE, QUEEN >(pos, ei); pieces<BLACK, QUEEN >(pos, ei);
 		
-		value += Mobility[WHITE] - Mobility[BLACK];
+		for (Phase ph = PHASE_MID; ph <= PHASE_END; ++ph)
+			score[ph] += ei.mobility[WHITE][ph] - ei.mobility[BLACK][ph]
+					   + ei.pe->king_safety(pos, WHITE, ph) - ei.pe->king_safety(pos, BLACK, ph);
+
+		value = interpolate(score, ei.me);
 
 		return (us == WHITE ? value : -value) + Evaluation::Tempo;
 	}
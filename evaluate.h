@@ -1,7 +1,23 @@
 #pragma once
 
+#include "material.h"
+#include "pawns.h"
 #include "position.h"
 
 namespace Evaluation {
+
+	// EvalInfo is the evaluation context. It holds the data computed during a
+	// single evaluation, so that any number of boards can be evaluated at once.
+	struct EvalInfo {
+		// me and pe are the material and pawn hash table entries of the
+		// evaluated position
+		Material::Entry* me;
+		Pawns::Entry* pe;
+
+		Bitboard mobilityArea[COLOR_NB];
+		Value mobility[COLOR_NB][PHASE_NB];
+	};
+
 	Value evaluate(const Position& pos);
+	Value evaluate(const Position& pos, EvalInfo& ei);
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cstring>
+
+#include "material.h"
+#include "position.h"
+#include "searchcontext.h"
+
+namespace Material {
+
+	// Polynomial material imbalance parameters
+
+	constexpr int QuadraticOurs[][PIECETYPE_NB] = {
+		//            OUR PIECES
+		// pair pawn knight bishop rook queen
+		{ 1438                               }, // Bishop pair
+		{   40,   38                         }, // Pawn
+		{   32,  255, -62                    }, // Knight      OUR PIECES
+		{    0,  104,   4,    0              }, // Bishop
+		{  -26,   -2,  47,  105, -208        }, // Rook
+		{ -189,   24, 117,  133, -134,   -6  }  // Queen
+	};
+
+	constexpr int QuadraticTheirs[][PIECETYPE_NB] = {
+		//           THEIR PIECES
+		// pair pawn knight bishop rook queen
+		{    0                               }, // Bishop pair
+		{   36,    0                         }, // Pawn
+		{    9,   63,   0                    }, // Knight      OUR PIECES
+		{   59,   65,  42,    0              }, // Bishop
+		{   46,   39,  24,  -24,    0        }, // Rook
+		{   97,  100, -42,  137,  268,    0  }  // Queen
+	};
+
+	// is_kxk() tests whether the given side has enough material to mate a
+	// lone enemy king.
+	static bool is_kxk(const Position& pos, Color us) {
+		return !more_than_one(pos.pieces(~us))
+			&& pos.non_pawn_material(us) >= RookValueMg;
+	}
+
+	// imbalance() calculates the imbalance by comparing the piece count of each
+	// piece type for both colors.
+	template<Color Us>
+	int imbalance(const int pieceCount[][PIECETYPE_NB]) {
+		constexpr Color Them = (Us == WHITE ? BLACK : WHITE);
+
+		int bonus = 0;
+
+		// Second-degree polynomial material imbalance, by Tord Romstad
+		for (PieceType pt1 = PIECETYPE_NONE; pt1 <= QUEEN; ++pt1)
+		{
+			if (!pieceCount[Us][pt1])
+				continue;
+
+			int v = 0;
+
+			for (PieceType pt2 = PIECETYPE_NONE; pt2 <= pt1; ++pt2)
+				v +=  QuadraticOurs[pt1][pt2] * pieceCount[Us][pt2]
+					+ QuadraticTheirs[pt1][pt2] * pieceCount[Them][pt2];
+
+			bonus += pieceCount[Us][pt1] * v;
+		}
+
+		return bonus;
+	}
+
+	// Material::probe() looks up the current position's material configuration
+	// in the material hash table. If it is not found, it is computed and stored
+	// in the table. The game phase, the imbalance and the endgame specific
+	// evaluation or scaling only depend on the material, so they are computed
+	// here once instead of at every evaluation.
+	Entry* probe(const Position& pos) {
+		Key key = pos.material_key();
+		Entry* e = pos.context().material_table()[key];
+
+		if (e->key == key)
+			return e;
+
+		std::memset(e, 0, sizeof(Entry));
+		e->key = key;
+		e->factor[WHITE] = e->factor[BLACK] = uint8_t(SCALE_FACTOR_NORMAL);
+
+		Value npmW = pos.non_pawn_material(WHITE);
+		Value npmB = pos.non_pawn_material(BLACK);
+		Value npm = std::max(EndgameLimit, std::min(npmW + npmB, MidgameLimit));
+
+		// Map total non-pawn material into [PhaseEndgame, PhaseMidgame]
+		e->gamePhase = ((npm - EndgameLimit) * PhaseMidgame) / (MidgameLimit - EndgameLimit);
+
+		// Look for a specialized evaluation function for this particular
+		// material configuration. Generic KXK is tried after the known endgames.
+		if ((e->evaluationFunction = Endgames::probe(key)) != nullptr)
+			return e;
+
+		for (Color c = WHITE; c <= BLACK; ++c)
+			if (is_kxk(pos, c)) {
+				e->evaluationFunction = &Endgames::KXK[c];
+				return e;
+			}
+
+		// Zero or just one pawn makes it difficult to win, even with a small
+		// material advantage. This catches some trivial draws like KK, KBK and
+		// KNK and gives a drawish scale factor for cases such as KRKBP and KmmKm
+		// (except for KBBKN).
+		for (Color c = WHITE; c <= BLACK; ++c) {
+			Value npmUs = pos.non_pawn_material(c);
+			Value npmThem = pos.non_pawn_material(~c);
+
+			if (!pos.pieces(c, PAWN) && npmUs - npmThem <= BishopValueMg)
+				e->factor[c] = uint8_t(npmUs < RookValueMg ? SCALE_FACTOR_DRAW
+									 : npmThem <= BishopValueMg ? 4 : 14);
+		}
+
+		// Evaluate the material imbalance. We use PIECETYPE_NONE as a place
+		// holder for the bishop pair "extended piece", which allows us to be
+		// more flexible in defining bishop pair bonuses.
+		const int pieceCount[COLOR_NB][PIECETYPE_NB] = {
+			{ popcount(pos.pieces(WHITE, BISHOP)) > 1, popcount(pos.pieces(WHITE, PAWN)), popcount(pos.pieces(WHITE, KNIGHT)),
+			  popcount(pos.pieces(WHITE, BISHOP)),     popcount(pos.pieces(WHITE, ROOK)), popcount(pos.pieces(WHITE, QUEEN)) },
+			{ popcount(pos.pieces(BLACK, BISHOP)) > 1, popcount(pos.pieces(BLACK, PAWN)), popcount(pos.pieces(BLACK, KNIGHT)),
+			  popcount(pos.pieces(BLACK, BISHOP)),     popcount(pos.pieces(BLACK, ROOK)), popcount(pos.pieces(BLACK, QUEEN)) } };
+
+		e->imbalance16 = int16_t((imbalance<WHITE>(pieceCount) - imbalance<BLACK>(pieceCount)) / 16);
+
+		return e;
+	}
+}
\ No newline at end of file
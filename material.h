@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "endgame.h"
+#include "utils/defs.h"
+
+class Position;
+
+namespace Material {
+
+	// Game phase runs from PhaseEndgame, with no more than EndgameLimit of non
+	// pawn material left, to PhaseMidgame, with at least MidgameLimit.
+	constexpr int PhaseEndgame = 0;
+	constexpr int PhaseMidgame = 128;
+
+	// Material::Entry contains various information about a material
+	// configuration. It contains a material imbalance evaluation, the game
+	// phase, and a specialized evaluation function or scale factors for some
+	// endgames.
+	struct Entry {
+		Value imbalance() const { return Value(imbalance16); }
+		int game_phase() const { return gamePhase; }
+		bool specialized_eval_exists() const { return evaluationFunction != nullptr; }
+		Value evaluate(const Position& pos) const { return (*evaluationFunction)(pos); }
+
+		// scale_factor() scales the endgame score of the given side when it is
+		// the stronger one. With little material left a bigger advantage is
+		// needed to win, and for some trivial draws the score is scaled to zero.
+		ScaleFactor scale_factor(Color c) const { return ScaleFactor(factor[c]); }
+
+		Key key;
+		const Endgames::Endgame* evaluationFunction;
+		int16_t imbalance16;
+		uint8_t factor[COLOR_NB];
+		int gamePhase;
+	};
+
+	// Material::Table is the material hash table. Like the pawn hash table,
+	// each search thread owns one.
+	class Table {
+	public:
+		static constexpr int Size = 8192;
+
+		Table() : entries_(Size) {}
+
+		Entry* operator[](Key key) { return &entries_[key & (Size - 1)]; }
+
+	private:
+		std::vector<Entry> entries_;
+	};
+
+	Entry* probe(const Position& pos);
+}
\ No newline at end of file
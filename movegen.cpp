@@ -2,42 +2,59 @@
 
 #include "movegen.h"
 #include "bitboard.h"
+#include "searchcontext.h"
 
 namespace Movegen {
 
-	const Order VictimScore[13] = {ORDER_ZERO , Order(100), Order(200), Order(300), Order(400),
-								   Order(500), Order(600), Order(100), Order(200), Order(300),
-								   Order(400), Order(500), Order(600) };
-	Order MvvLVaScores[13][13];
+	constexpr Order VictimScore[13] = {ORDER_ZERO , Order(100), Order(200), Order(300), Order(400),
+									   Order(500), Order(600), Order(100), Order(200), Order(300),
+									   Order(400), Order(500), Order(600) };
+
+	constexpr Array<Array<Order, 13>, 13> make_mvvlva() {
+		Array<Array<Order, 13>, 13> t = {};
 
-	void init_mvvlva() {
 		for (int attacker = 0; attacker <= 12; ++attacker) {
 			for (int victim = 0; victim <= 12; ++victim) {
-				MvvLVaScores[victim][attacker] = VictimScore[victim] + Order(6) - (VictimScore[attacker] / 100);
+				t[victim][attacker] = VictimScore[victim] + Order(6) - (VictimScore[attacker] / 100);
 			}
 		}
+
+		return t;
 	}
 
+	constexpr Array<Array<Order, 13>, 13> MvvLVaScores = make_mvvlva();
+
+	// Moves are generated by type. Captures and quiets together make up all
+	// moves, as do evasions when in check and non evasions otherwise.
+	enum GenType { CAPTURES, QUIETS, EVASIONS, NON_EVASIONS };
+
 	static void add_quiet(const Position& pos, Movelist& list, Move move) {
+		const SearchContext& ctx = pos.context();
+
 		list.moves[list.count].move = move;
 
-		if (move == pos.killer_move1())
+		if (move == ctx.killer_move1(pos.ply()))
 			list.moves[list.count].order = ORDER_KILLER1;
-		else if (move == pos.killer_move2())
+		else if (move == ctx.killer_move2(pos.ply()))
 			list.moves[list.count].order = ORDER_KILLER2;
 		else
-			list.moves[list.count].order = pos.history_move(move);
+			list.moves[list.count].order = ctx.history_move(pos.side_to_move(), move);
 
 		list.count++;
 	}
 
 	static void add_capture(const Position& pos, Movelist& list, Move move) {
 		list.moves[list.count].move = move;
-		list.moves[list.count].order = MvvLVaScores[captured_piece(move)][moved_piece(move)] + ORDER_CAPTURE;
+		list.moves[list.count].order = MvvLVaScores[pos.captured_piece(move)][pos.moved_piece(move)] + ORDER_CAPTURE
+									 + pos.context().capture_history(pos, move);
 		list.count++;
 	}
 
 	static void add_ep(const Position& pos, Movelist& list, Move move) {
+		// En passant can uncover a check on the rank of both pawns, test it directly
+		if (!pos.legal(move))
+			return;
+
 		list.moves[list.count].move = move;
 		list.moves[list.count].order = ORDER_EP;
 		list.count++;
@@ -51,10 +68,10 @@ namespace Movegen {
 		
 		switch (prom)
 		{
-		case QUEEN: list.moves[list.count].order = ORDER_PROM_Q;
-		case KNIGHT: list.moves[list.count].order = ORDER_PROM_N;
-		case BISHOP: list.moves[list.count].order = ORDER_PROM_B;
-		case ROOK: list.moves[list.count].order = ORDER_PROM_R;
+		case QUEEN: list.moves[list.count].order = ORDER_PROM_Q; break;
+		case KNIGHT: list.moves[list.count].order = ORDER_PROM_N; break;
+		case BISHOP: list.moves[list.count].order = ORDER_PROM_B; break;
+		case ROOK: list.moves[list.count].order = ORDER_PROM_R; break;
 		}
 		list.count++;
 	}
@@ -63,9 +80,10 @@ namespace Movegen {
 		if (pos.side_to_move() == WHITE) {
 			if (pos.can_castle(WKCA)) {
 				if ((pos.piece_on_sq(SQ_F1) == PIECETYPE_NONE) && (pos.piece_on_sq(SQ_G1) == PIECETYPE_NONE)) {
-					if (!(pos.attackers_to(SQ_E1) & OccupiedBB[BLACK][PIECETYPE_ANY])) {
-						if (!(pos.attackers_to(SQ_F1) & OccupiedBB[BLACK][PIECETYPE_ANY])) {
-							add_quiet(pos, list, make(SQ_E1, SQ_G1, KING, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_CASTLE));
+					if (!(pos.attackers_to(SQ_E1) & pos.pieces(BLACK))) {
+						if (   !(pos.attackers_to(SQ_F1) & pos.pieces(BLACK))
+							&& !(pos.attackers_to(SQ_G1) & pos.pieces(BLACK))) {
+							add_quiet(pos, list, make<CASTLING>(SQ_E1, SQ_G1));
 						}
 					}
 				}
@@ -73,9 +91,10 @@ namespace Movegen {
 
 			if (pos.can_castle(WQCA)) {
 				if ((pos.piece_on_sq(SQ_D1) == PIECETYPE_NONE) && (pos.piece_on_sq(SQ_C1) == PIECETYPE_NONE) && (pos.piece_on_sq(SQ_B1) == PIECETYPE_NONE)) {
-					if (!(pos.attackers_to(SQ_E1) & OccupiedBB[BLACK][PIECETYPE_ANY])) {
-						if (!(pos.attackers_to(SQ_D1) & OccupiedBB[BLACK][PIECETYPE_ANY])) {
-							add_quiet(pos, list, make(SQ_E1, SQ_C1, KING, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_CASTLE));
+					if (!(pos.attackers_to(SQ_E1) & pos.pieces(BLACK))) {
+						if (   !(pos.attackers_to(SQ_D1) & pos.pieces(BLACK))
+							&& !(pos.attackers_to(SQ_C1) & pos.pieces(BLACK))) {
+							add_quiet(pos, list, make<CASTLING>(SQ_E1, SQ_C1));
 						}
 					}
 				}
@@ -84,9 +103,10 @@ namespace Movegen {
 		} else {
 			if (pos.can_castle(BKCA)) {
 				if ((pos.piece_on_sq(SQ_F8) == PIECETYPE_NONE) && (pos.piece_on_sq(SQ_G8) == PIECETYPE_NONE)) {
-					if (!(pos.attackers_to(SQ_E8) & OccupiedBB[WHITE][PIECETYPE_ANY])) {
-						if (!(pos.attackers_to(SQ_F8) & OccupiedBB[WHITE][PIECETYPE_ANY])) {
-							add_quiet(pos, list, make(SQ_E8, SQ_G8, KING, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_CASTLE));
+					if (!(pos.attackers_to(SQ_E8) & pos.pieces(WHITE))) {
+						if (   !(pos.attackers_to(SQ_F8) & pos.pieces(WHITE))
+							&& !(pos.attackers_to(SQ_G8) & pos.pieces(WHITE))) {
+							add_quiet(pos, list, make<CASTLING>(SQ_E8, SQ_G8));
 						}
 					}
 				}
@@ -94,9 +114,10 @@ namespace Movegen {
 
 			if (pos.can_castle(BQCA)) {
 				if ((pos.piece_on_sq(SQ_D8) == PIECETYPE_NONE) && (pos.piece_on_sq(SQ_C8) == PIECETYPE_NONE) && (pos.piece_on_sq(SQ_B8) == PIECETYPE_NONE)) {
-					if (!(pos.attackers_to(SQ_E8) & OccupiedBB[WHITE][PIECETYPE_ANY])) {
-						if (!(pos.attackers_to(SQ_D8) & OccupiedBB[WHITE][PIECETYPE_ANY])) {
-							add_quiet(pos, list, make(SQ_E8, SQ_C8, KING, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_CASTLE));
+					if (!(pos.attackers_to(SQ_E8) & pos.pieces(WHITE))) {
+						if (   !(pos.attackers_to(SQ_D8) & pos.pieces(WHITE))
+							&& !(pos.attackers_to(SQ_C8) & pos.pieces(WHITE))) {
+							add_quiet(pos, list, make<CASTLING>(SQ_E8, SQ_C8));
 						}
 					}
 				}
@@ -104,239 +125,234 @@ namespace Movegen {
 		}
 	}
 
-	// Noisy pawn moves: captures, promotions, en passant
-	void add_pawn_moves_noisy(Position& pos, Movelist& list, Square from) {
-		Rank rank = rank_of(from);
-		Color us = pos.side_to_move();
-		Bitboard captures = pos.attacks_from<PAWN>(from, us) & OccupiedBB[~us][PIECETYPE_ANY];
-
-		if (us == WHITE) {
-
-			if (rank == RANK_7) {
-				Bitboard singlePushMoves = single_push_targets_white(SquareBB[from], ~OccupiedBB[BOTH][PIECETYPE_ANY]);
+	// add_promotions() adds the four promotions of a pawn which moved in the
+	// direction D to the given square.
+	template<Direction D>
+	static void add_promotions(const Position& pos, Movelist& list, Square to) {
+		Square from = to - D;
 
-				while (singlePushMoves) {
-					Square to = pop_lsb(&singlePushMoves);
-
-					add_promotion(pos, list, make(from, to, PAWN, PIECETYPE_NONE, QUEEN, FLAG_NONE), QUEEN);
-					add_promotion(pos, list, make(from, to, PAWN, PIECETYPE_NONE, ROOK, FLAG_NONE), ROOK);
-					add_promotion(pos, list, make(from, to, PAWN, PIECETYPE_NONE, BISHOP, FLAG_NONE), BISHOP);
-					add_promotion(pos, list, make(from, to, PAWN, PIECETYPE_NONE, KNIGHT, FLAG_NONE), KNIGHT);
-				}
-
-				while (captures) 
-				{
-					Square to = pop_lsb(&captures);
-					PieceType capturedPiece = pos.piece_on_sq(to);
+		add_promotion(pos, list, make<PROMOTION>(from, to, QUEEN), QUEEN);
+		add_promotion(pos, list, make<PROMOTION>(from, to, ROOK), ROOK);
+		add_promotion(pos, list, make<PROMOTION>(from, to, BISHOP), BISHOP);
+		add_promotion(pos, list, make<PROMOTION>(from, to, KNIGHT), KNIGHT);
+	}
 
-					add_promotion(pos, list, make(from, to, PAWN, capturedPiece, QUEEN, FLAG_NONE), QUEEN);
-					add_promotion(pos, list, make(from, to, PAWN, capturedPiece, ROOK, FLAG_NONE), ROOK);
-					add_promotion(pos, list, make(from, to, PAWN, capturedPiece, BISHOP, FLAG_NONE), BISHOP);
-					add_promotion(pos, list, make(from, to, PAWN, capturedPiece, KNIGHT, FLAG_NONE), KNIGHT);
-				}
+	// generate_pawn_moves() generates the moves of the given pawns to the target
+	// squares. The destinations of each kind of move are computed for all pawns
+	// at once by shifting the pawn bitboard, and the origin of a move is found
+	// back from its destination. Promotions, also quiet ones, and en passant
+	// belong to the captures.
+	template<Color Us, GenType Type>
+	static void generate_pawn_moves(const Position& pos, Movelist& list, Bitboard pawns, Bitboard target) {
+		constexpr Color Them = ~Us;
+		constexpr Bitboard TRank7BB = Us == WHITE ? Rank7BB : Rank2BB;
+		constexpr Bitboard TRank3BB = Us == WHITE ? Rank3BB : Rank6BB;
+		constexpr Direction Up = Us == WHITE ? NORTH : SOUTH;
+		constexpr Direction UpRight = Us == WHITE ? NORTH_EAST : SOUTH_WEST;
+		constexpr Direction UpLeft = Us == WHITE ? NORTH_WEST : SOUTH_EAST;
+
+		Bitboard empty = ~pos.pieces();
+		Bitboard enemies = pos.pieces(Them);
+		Bitboard pawnsOn7 = pawns & TRank7BB;
+		Bitboard pawnsNotOn7 = pawns & ~TRank7BB;
+
+		// Single and double pushes, no promotions
+		if (Type != CAPTURES) {
+			Bitboard b1 = shift<Up>(pawnsNotOn7) & empty;
+			Bitboard b2 = shift<Up>(b1 & TRank3BB) & empty;
+
+			b1 &= target;
+			b2 &= target;
+
+			while (b1) {
+				Square to = pop_lsb(&b1);
+				add_quiet(pos, list, make_move(to - Up, to));
 			}
-			else
-			{
-				while (captures) 
-				{
-					Square to = pop_lsb(&captures);
-					PieceType capturedPiece = pos.piece_on_sq(to);
-
-					add_capture(pos, list, make(from, to, PAWN, capturedPiece, PIECETYPE_NONE, FLAG_NONE));
-				}
-
-				if (rank == RANK_5) 
-				{
-					if (from + NORTH_WEST == pos.en_passant())
-						add_ep(pos, list, make(from, from + NORTH_WEST, PAWN, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_EP));
 
-					else if (from + NORTH_EAST == pos.en_passant())
-						add_ep(pos, list, make(from, from + NORTH_EAST, PAWN, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_EP));
-				}
+			while (b2) {
+				Square to = pop_lsb(&b2);
+				add_quiet(pos, list, make_move(to - Up - Up, to));
 			}
 		}
-		else // Black moves
-		{
 
-			if (rank == RANK_2) 
-			{
-				Bitboard singlePushMoves = single_push_targets_black(SquareBB[from], ~OccupiedBB[BOTH][PIECETYPE_ANY]);
+		if (Type == QUIETS)
+			return;
 
-				while (singlePushMoves) {
-					Square to = pop_lsb(&singlePushMoves);
+		// Promotions by capture and by push
+		if (pawnsOn7) {
+			Bitboard b1 = shift<UpRight>(pawnsOn7) & enemies & target;
+			Bitboard b2 = shift<UpLeft>(pawnsOn7) & enemies & target;
+			Bitboard b3 = shift<Up>(pawnsOn7) & empty & target;
 
-					add_promotion(pos, list, make(from, to, PAWN, PIECETYPE_NONE, QUEEN, FLAG_NONE), QUEEN);
-					add_promotion(pos, list, make(from, to, PAWN, PIECETYPE_NONE, ROOK, FLAG_NONE), ROOK);
-					add_promotion(pos, list, make(from, to, PAWN, PIECETYPE_NONE, BISHOP, FLAG_NONE), BISHOP);
-					add_promotion(pos, list, make(from, to, PAWN, PIECETYPE_NONE, KNIGHT, FLAG_NONE), KNIGHT);
-				}
+			while (b1)
+				add_promotions<UpRight>(pos, list, pop_lsb(&b1));
 
-				while (captures) {
-					Square to = pop_lsb(&captures);
-					PieceType capturedPiece = pos.piece_on_sq(to);
+			while (b2)
+				add_promotions<UpLeft>(pos, list, pop_lsb(&b2));
 
-					add_promotion(pos, list, make(from, to, PAWN, capturedPiece, QUEEN, FLAG_NONE), QUEEN);
-					add_promotion(pos, list, make(from, to, PAWN, capturedPiece, ROOK, FLAG_NONE), ROOK);
-					add_promotion(pos, list, make(from, to, PAWN, capturedPiece, BISHOP, FLAG_NONE), BISHOP);
-					add_promotion(pos, list, make(from, to, PAWN, capturedPiece, KNIGHT, FLAG_NONE), KNIGHT);
-				}
-
-			}
-			else 
-			{
-				while (captures) 
-				{
-					Square to = pop_lsb(&captures);
-					PieceType capturedPiece = pos.piece_on_sq(to);
-
-					add_capture(pos, list, make(from, to, PAWN, capturedPiece, PIECETYPE_NONE, FLAG_NONE));
-				}
-
-				if (rank == RANK_4) 
-				{
-					if (from + SOUTH_EAST == pos.en_passant())
-						add_ep(pos, list, make(from, from + SOUTH_EAST, PAWN, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_EP));
-
-					else if (from + SOUTH_WEST == pos.en_passant())
-						add_ep(pos, list, make(from, from + SOUTH_WEST, PAWN, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_EP));
-				}
-			}
+			while (b3)
+				add_promotions<Up>(pos, list, pop_lsb(&b3));
 		}
-	}
-
-	// Quiet pawn moves: pawn pushes (1 or 2 steps)
-	void add_pawn_moves_quiet(Position& pos, Movelist& list, Square from) {
-		Rank rank = rank_of(from);
-		Color us = pos.side_to_move();
 
-		// All promotion moves are considered noisy
-		if (   us == WHITE && rank == RANK_7 
-			|| us == BLACK && rank == RANK_2) return;
+		// Captures
+		Bitboard b1 = shift<UpRight>(pawnsNotOn7) & enemies & target;
+		Bitboard b2 = shift<UpLeft>(pawnsNotOn7) & enemies & target;
 
-		if (us == WHITE) {
-			Bitboard singlePushMoves = single_push_targets_white(SquareBB[from], ~OccupiedBB[BOTH][PIECETYPE_ANY]);
-
-			while (singlePushMoves) {
-				Square to = pop_lsb(&singlePushMoves);
-
-				add_quiet(pos, list, make(from, to, PAWN, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_NONE));
-			}
-
-			if (rank == RANK_2) 
-			{
-				Bitboard doublePushMoves = double_push_targets_white(SquareBB[from], ~OccupiedBB[BOTH][PIECETYPE_ANY]);
-
-				while (doublePushMoves) 
-				{
-					Square to = pop_lsb(&doublePushMoves);
-					
-					add_quiet(pos, list, make(from, to, PAWN, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_PS));
-				}
-			}
+		while (b1) {
+			Square to = pop_lsb(&b1);
+			add_capture(pos, list, make_move(to - UpRight, to));
 		}
-		else // Black moves
-		{
-			Bitboard singlePushMoves = single_push_targets_black(SquareBB[from], ~OccupiedBB[BOTH][PIECETYPE_ANY]);
-
-			while (singlePushMoves) 
-			{
-				Square to = pop_lsb(&singlePushMoves);
 
-				add_quiet(pos, list, make(from, to, PAWN, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_NONE));
-			}
+		while (b2) {
+			Square to = pop_lsb(&b2);
+			add_capture(pos, list, make_move(to - UpLeft, to));
+		}
 
-			if (rank == RANK_7) 
-			{
-				Bitboard doublePushMoves = double_push_targets_black(SquareBB[from], ~OccupiedBB[BOTH][PIECETYPE_ANY]);
-				
-				while (doublePushMoves) 
-				{
-					Square to = pop_lsb(&doublePushMoves);
+		// En passant is not restricted to the target squares, the captured pawn
+		// is not on the destination. add_ep() tests the move directly.
+		if (pos.en_passant() != SQ_NONE) {
+			b1 = pawnsNotOn7 & pos.attacks_from<PAWN>(pos.en_passant(), Them);
 
-					add_quiet(pos, list, make(from, to, PAWN, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_PS));
-				}
-			}
+			while (b1)
+				add_ep(pos, list, make<ENPASSANT>(pop_lsb(&b1), pos.en_passant()));
 		}
 	}
 
 	// Piece moves that capture something
 	void add_piece_moves_noisy(Position& pos, Movelist& list, Square from, Bitboard captures) {
-		PieceType movingPt = pos.piece_on_sq(from);
-
-		assert(is_ok(movingPt));
-		assert(movingPt != PAWN);
-
 		while (captures) 
 		{
 			Square to = pop_lsb(&captures);
-			PieceType capturedPt = pos.piece_on_sq(to);
 
-			assert(is_ok(capturedPt));
+			assert(is_ok(pos.piece_on_sq(to)));
 
-			add_capture(pos, list, make(from, to, movingPt, capturedPt, PIECETYPE_NONE, FLAG_NONE));
+			add_capture(pos, list, make_move(from, to));
 		}
 	}
 
 	// Piece moves that don't capture anything
 	void add_piece_moves_quiet(Position& pos, Movelist& list, Square from, Bitboard quiets) {
-		PieceType movingPt = pos.piece_on_sq(from);
-
 		while (quiets) 
 		{
 			Square to = pop_lsb(&quiets);
 
 			assert(pos.piece_on_sq(to) == PIECETYPE_NONE);
 
-			add_quiet(pos, list, make(from, to, movingPt, PIECETYPE_NONE, PIECETYPE_NONE, FLAG_NONE));
+			add_quiet(pos, list, make_move(from, to));
 		}
 	}
 
-	void get_moves(Position& pos, Movelist& list) {
-		Color us = pos.side_to_move();
-		Color them = ~us;
-		Bitboard pawns = OccupiedBB[us][PAWN];
-		Bitboard pieces = OccupiedBB[us][PIECETYPE_ANY] ^ pawns;
+	// check_mask() returns the squares where a non king move must land when we
+	// are in check: on the checking piece or between it and our king.
+	static Bitboard check_mask(const Position& pos) {
+		Bitboard checkers = pos.checkers();
 
-		while (pawns)
-		{
-			Square from = pop_lsb(&pawns);
+		if (!checkers)
+			return AllSquares;
+
+		return more_than_one(checkers) ? 0 : between_bb(pos.king_sq(), lsb(checkers)) | checkers;
+	}
+
+	// safe_king_targets() keeps the target squares of our king which are not
+	// attacked once the king has left its square.
+	static Bitboard safe_king_targets(const Position& pos, Bitboard targets) {
+		Square ksq = pos.king_sq();
+		Bitboard occ = pos.pieces() ^ ksq;
+		Bitboard safe = 0;
+
+		while (targets) {
+			Square to = pop_lsb(&targets);
+
+			if (!(pos.attackers_to(to, occ) & pos.pieces(~pos.side_to_move())))
+				safe |= to;
+		}
+
+		return safe;
+	}
+
+	// generate_all() generates the legal moves of the given type for the side
+	// to move Us. Non king moves must land on the check mask, and pinned pieces
+	// may only move along the line through their king. In double check only
+	// the king can move.
+	template<Color Us, GenType Type>
+	static void generate_all(Position& pos, Movelist& list) {
+		constexpr Color Them = ~Us;
+		Square ksq = pos.king_sq();
+		Bitboard pinned = pos.pinned();
+		Bitboard kingTargets = Type == CAPTURES ? pos.pieces(Them)
+							 : Type == QUIETS ? ~pos.pieces()
+							 : ~pos.pieces(Us);
+		Bitboard kingMoves = safe_king_targets(pos, pos.attacks_from<KING>(ksq) & kingTargets);
+
+		assert(Type != EVASIONS || pos.checkers());
+		assert(Type != NON_EVASIONS || !pos.checkers());
+
+		// Evasions start with the king moves
+		if (Type == EVASIONS) {
+			add_piece_moves_noisy(pos, list, ksq, kingMoves & pos.pieces(Them));
+			add_piece_moves_quiet(pos, list, ksq, kingMoves & ~pos.pieces(Them));
+
+			if (more_than_one(pos.checkers()))
+				return;
+		}
+
+		Bitboard checkMask = check_mask(pos);
+		Bitboard target = checkMask & kingTargets;
+		Bitboard pawns = pos.pieces(Us, PAWN);
+		Bitboard pieces = pos.pieces(Us) ^ pawns ^ ksq;
+
+		// Pawns which are not pinned are all handled at once, pinned pawns one
+		// by one with their pin line as target.
+		generate_pawn_moves<Us, Type>(pos, list, pawns & ~pinned, checkMask);
 
-			add_pawn_moves_noisy(pos, list, from);
-			add_pawn_moves_quiet(pos, list, from);
+		for (Bitboard b = pawns & pinned; b; ) {
+			Square from = pop_lsb(&b);
+			generate_pawn_moves<Us, Type>(pos, list, SquareBB[from], checkMask & LineBB[ksq][from]);
 		}
 
-		while (pieces) 
+		while (pieces)
 		{
 			Square from = pop_lsb(&pieces);
-			PieceType movingPt = pos.piece_on_sq(from);
-			Bitboard moves = pos.attacks_from(movingPt, from) & (~OccupiedBB[us][PIECETYPE_ANY]);
-			Bitboard captures = moves & OccupiedBB[them][PIECETYPE_ANY];
+			Bitboard moves = pos.attacks_from(pos.piece_on_sq(from), from) & target;
+
+			if (pinned & from)
+				moves &= LineBB[ksq][from];
 
-			add_piece_moves_noisy(pos, list, from, captures);
-			add_piece_moves_quiet(pos, list, from, moves ^ captures);
+			add_piece_moves_noisy(pos, list, from, moves & pos.pieces(Them));
+			add_piece_moves_quiet(pos, list, from, moves & ~pos.pieces(Them));
 		}
 
-		if (pos.castling_rights())
+		if (Type != EVASIONS) {
+			add_piece_moves_noisy(pos, list, ksq, kingMoves & pos.pieces(Them));
+			add_piece_moves_quiet(pos, list, ksq, kingMoves & ~pos.pieces(Them));
+		}
+
+		if (Type != CAPTURES && Type != EVASIONS && pos.castling_rights())
 			add_castling_moves(pos, list);
 	}
+
+	template<GenType Type>
+	static void generate(Position& pos, Movelist& list) {
+		pos.side_to_move() == WHITE ? generate_all<WHITE, Type>(pos, list)
+									: generate_all<BLACK, Type>(pos, list);
+	}
+
+	void get_moves(Position& pos, Movelist& list) {
+		pos.checkers() ? generate<EVASIONS>(pos, list)
+					   : generate<NON_EVASIONS>(pos, list);
+	}
 	
 	void get_moves_noisy(Position& pos, Movelist& list) {
-		Color us = pos.side_to_move();
-		Color them = ~us;
-		Bitboard pawns = OccupiedBB[us][PAWN];
-		Bitboard pieces = OccupiedBB[us][PIECETYPE_ANY] ^ pawns;
+		generate<CAPTURES>(pos, list);
+	}
 
-		while (pawns)
-			add_pawn_moves_noisy(pos, list, pop_lsb(&pawns));
+	void get_moves_quiet(Position& pos, Movelist& list) {
+		generate<QUIETS>(pos, list);
+	}
 
-		while (pieces)
-		{
-			Square from = pop_lsb(&pieces);
-			PieceType movingPt = pos.piece_on_sq(from);
-			Bitboard captures = pos.attacks_from(movingPt, from) & (~OccupiedBB[us][PIECETYPE_ANY]);
-			captures &= OccupiedBB[them][PIECETYPE_ANY];
+	void get_evasions(Position& pos, Movelist& list) {
+		assert(pos.checkers());
 
-			add_piece_moves_noisy(pos, list, from, captures);
-		}
+		generate<EVASIONS>(pos, list);
 	}
 }
\ No newline at end of file
@@ -4,8 +4,9 @@
 #include "utils/defs.h"
 
 namespace Movegen {
-	void init_mvvlva();
-
+	// All move generators emit legal moves only
 	void get_moves(Position& pos, Movelist& list);
 	void get_moves_noisy(Position& pos, Movelist& list);
+	void get_moves_quiet(Position& pos, Movelist& list);
+	void get_evasions(Position& pos, Movelist& list);
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include <algorithm>
+
+#include "movepick.h"
+#include "movegen.h"
+#include "searchcontext.h"
+
+namespace {
+
+	enum Stages {
+		MAIN_TT, CAPTURES_INIT, GOOD_CAPTURES, KILLER1, KILLER2, QUIETS_INIT, QUIETS, BAD_CAPTURES, END,
+		EVASION_TT, EVASIONS_INIT, EVASIONS, EVASIONS_END,
+		QSEARCH_TT, QCAPTURES_INIT, QCAPTURES, QEND
+	};
+}
+
+// Constructor for the main search. When in check, only evasions are generated.
+MovePicker::MovePicker(Position& pos, Move ttMove) 
+	: pos_(pos), list_(pos.context().move_list(pos.ply())) {
+
+	ttMove_ = ttMove && pos.pseudo_legal(ttMove) && pos.legal(ttMove) ? ttMove : MOVE_NONE;
+	killers_[0] = pos.context().killer_move1(pos.ply());
+	killers_[1] = pos.context().killer_move2(pos.ply());
+	stage_ = pos.checkers() ? EVASION_TT : MAIN_TT;
+	stage_ += !ttMove_;
+}
+
+// Constructor for quiescence search, only noisy tt moves are accepted unless
+// we are in check, then all evasions are searched.
+MovePicker::MovePicker(Position& pos, Move ttMove, Depth depth) 
+	: pos_(pos), list_(pos.context().move_list(pos.ply())) {
+
+	assert(depth <= DEPTH_ZERO);
+
+	ttMove_ = ttMove 
+		   && (pos.checkers() || pos.capture_or_promotion(ttMove)) 
+		   && pos.pseudo_legal(ttMove) 
+		   && pos.legal(ttMove) ? ttMove : MOVE_NONE;
+	killers_[0] = killers_[1] = MOVE_NONE;
+	stage_ = pos.checkers() ? EVASION_TT : QSEARCH_TT;
+	stage_ += !ttMove_;
+}
+
+// MovePicker::pick_best() swaps the best scored move of the current stage
+// to the front and returns it.
+Move MovePicker::pick_best() {
+	int bestNum = cur_;
+
+	for (int index = cur_ + 1; index < list_.count; ++index)
+		if (list_.moves[index].order > list_.moves[bestNum].order)
+			bestNum = index;
+
+	std::swap(list_.moves[cur_], list_.moves[bestNum]);
+
+	return list_.moves[cur_++].move;
+}
+
+// MovePicker::next_move() returns the next legal move to be searched,
+// or MOVE_NONE when there are no more moves left.
+Move MovePicker::next_move() {
+	Move move;
+
+	switch (stage_) {
+
+	case MAIN_TT:
+	case EVASION_TT:
+	case QSEARCH_TT:
+		++stage_;
+		return ttMove_;
+
+	case CAPTURES_INIT:
+	case QCAPTURES_INIT:
+		cur_ = endBad_ = list_.count = 0;
+		Movegen::get_moves_noisy(pos_, list_);
+		++stage_;
+		return next_move();
+
+	case GOOD_CAPTURES:
+		while (cur_ < list_.count)
+			if ((move = pick_best()) != ttMove_) {
+
+				// Captures losing material are tried after the quiet moves
+				if (!pos_.see(move, VALUE_ZERO)) {
+					list_.moves[endBad_++] = list_.moves[cur_ - 1];
+					continue;
+				}
+
+				return move;
+			}
+
+		++stage_;
+		return next_move();
+
+	case QCAPTURES:
+		while (cur_ < list_.count)
+			if ((move = pick_best()) != ttMove_)
+				return move;
+
+		++stage_;
+		return next_move();
+
+	case KILLER1:
+	case KILLER2:
+		move = killers_[stage_ - KILLER1];
+
+		// Killers are quiet moves from a sibling node, check they are still playable
+		if (   move != MOVE_NONE
+			&& move != ttMove_
+			&& (stage_ == KILLER1 || move != killers_[0])
+			&& !pos_.capture_or_promotion(move)
+			&& pos_.pseudo_legal(move)
+			&& pos_.legal(move))
+		{
+			++stage_;
+			return move;
+		}
+
+		++stage_;
+		return next_move();
+
+	case QUIETS_INIT:
+		cur_ = list_.count;
+		Movegen::get_moves_quiet(pos_, list_);
+		++stage_;
+		return next_move();
+
+	case QUIETS:
+		while (cur_ < list_.count)
+			if (   (move = pick_best()) != ttMove_
+				&& move != killers_[0]
+				&& move != killers_[1])
+				return move;
+
+		// Bad captures were moved to the front of the list
+		cur_ = 0;
+		++stage_;
+		return next_move();
+
+	case BAD_CAPTURES:
+		if (cur_ < endBad_)
+			return list_.moves[cur_++].move;
+
+		++stage_;
+		return next_move();
+
+	case EVASIONS_INIT:
+		cur_ = list_.count = 0;
+		Movegen::get_evasions(pos_, list_);
+		++stage_;
+		return next_move();
+
+	case EVASIONS:
+		while (cur_ < list_.count)
+			if ((move = pick_best()) != ttMove_)
+				return move;
+
+		++stage_;
+		return next_move();
+
+	case END:
+	case EVASIONS_END:
+	case QEND:
+		return MOVE_NONE;
+	}
+
+	assert(false);
+	return MOVE_NONE;
+}
\ No newline at end of file
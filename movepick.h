@@ -0,0 +1,27 @@
+#pragma once
+
+#include "position.h"
+#include "utils/defs.h"
+
+// MovePicker is used to pick one legal move at a time from the current
+// position. The moves are returned in stages, and each stage is generated and
+// scored only when it is reached, so that a beta cutoff on one of the first
+// moves saves the work of generating and scoring the rest.
+class MovePicker {
+public:
+	MovePicker(Position& pos, Move ttMove);
+	MovePicker(Position& pos, Move ttMove, Depth depth);
+
+	Move next_move();
+
+private:
+	Move pick_best();
+
+	Position& pos_;
+	Move ttMove_;
+	Move killers_[2];
+	int stage_;
+	int cur_;
+	int endBad_;
+	Movelist& list_;
+};
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "nnue.h"
+#include "position.h"
+#include "utils/cpu.h"
+
+// SSE2 is part of every x86-64 processor, so its kernels are chosen when the
+// engine is built. The AVX2 kernels are built next to them and used if
+// CPU::init() found AVX2, so that one binary runs on all of them.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#define USE_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace NNUE {
+
+	constexpr char NetFileMagic[4] = { 'C', '1', 'N', 'N' };
+	constexpr uint32_t NetFileVersion = 1;
+
+	// A network file starts with this header, followed by the feature
+	// transformer biases (int16) and weights (int16, one row of HiddenSize per
+	// input), the output bias (int32) and the output weights (int8, side to
+	// move half first). All values are little endian.
+	struct NetFileHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t inputSize;
+		uint32_t hiddenSize;
+	};
+
+	alignas(64) int16_t FeatureBiases[HiddenSize];
+	alignas(64) int16_t FeatureWeights[InputSize * HiddenSize];
+	alignas(64) int8_t OutputWeights[OutputInputs];
+	int32_t OutputBias;
+
+	bool Enabled = false;
+	bool UseNNUE = false;
+	bool Loaded = false;
+
+	// feature_index() returns the input of a piece, seen from the given
+	// perspective.
+	static int feature_index(Color perspective, Color c, PieceType pt, Square s) {
+		return ((c != perspective) * 6 + pt - PAWN) * SQUARE_NB + (perspective == WHITE ? s : ~s);
+	}
+
+	static const int16_t* feature_row(Color perspective, Color c, PieceType pt, Square s) {
+		return FeatureWeights + feature_index(perspective, c, pt, s) * HiddenSize;
+	}
+
+	// Accumulator kernels. Rows are HiddenSize int16 weights, a multiple of the
+	// vector width. Accumulators are not guaranteed to be aligned, weights are.
+#if defined(USE_AVX2)
+	TARGET_AVX2 static void add_row_avx2(int16_t* acc, const int16_t* row) {
+		for (int i = 0; i < HiddenSize; i += 16) {
+			__m256i* a = reinterpret_cast<__m256i*>(acc + i);
+			const __m256i* w = reinterpret_cast<const __m256i*>(row + i);
+			_mm256_storeu_si256(a, _mm256_add_epi16(_mm256_loadu_si256(a), _mm256_load_si256(w)));
+		}
+	}
+#endif
+
+	static void add_row(int16_t* acc, const int16_t* row) {
+#if defined(USE_AVX2)
+		if (CPU::HasAvx2) {
+			add_row_avx2(acc, row);
+			return;
+		}
+#endif
+#if defined(USE_SSE2)
+		for (int i = 0; i < HiddenSize; i += 8) {
+			__m128i* a = reinterpret_cast<__m128i*>(acc + i);
+			const __m128i* w = reinterpret_cast<const __m128i*>(row + i);
+			_mm_storeu_si128(a, _mm_add_epi16(_mm_loadu_si128(a), _mm_load_si128(w)));
+		}
+#else
+		for (int i = 0; i < HiddenSize; ++i)
+			acc[i] += row[i];
+#endif
+	}
+
+#if defined(USE_AVX2)
+	TARGET_AVX2 static void sub_row_avx2(int16_t* acc, const int16_t* row) {
+		for (int i = 0; i < HiddenSize; i += 16) {
+			__m256i* a = reinterpret_cast<__m256i*>(acc + i);
+			const __m256i* w = reinterpret_cast<const __m256i*>(row + i);
+			_mm256_storeu_si256(a, _mm256_sub_epi16(_mm256_loadu_si256(a), _mm256_load_si256(w)));
+		}
+	}
+#endif
+
+	static void sub_row(int16_t* acc, const int16_t* row) {
+#if defined(USE_AVX2)
+		if (CPU::HasAvx2) {
+			sub_row_avx2(acc, row);
+			return;
+		}
+#endif
+#if defined(USE_SSE2)
+		for (int i = 0; i < HiddenSize; i += 8) {
+			__m128i* a = reinterpret_cast<__m128i*>(acc + i);
+			const __m128i* w = reinterpret_cast<const __m128i*>(row + i);
+			_mm_storeu_si128(a, _mm_sub_epi16(_mm_loadu_si128(a), _mm_load_si128(w)));
+		}
+#else
+		for (int i = 0; i < HiddenSize; ++i)
+			acc[i] -= row[i];
+#endif
+	}
+
+	// add_sub_row() adds one row and subtracts another in a single pass, as
+	// needed to move a piece.
+#if defined(USE_AVX2)
+	TARGET_AVX2 static void add_sub_row_avx2(int16_t* acc, const int16_t* add, const int16_t* sub) {
+		for (int i = 0; i < HiddenSize; i += 16) {
+			__m256i* a = reinterpret_cast<__m256i*>(acc + i);
+			const __m256i* wa = reinterpret_cast<const __m256i*>(add + i);
+			const __m256i* ws = reinterpret_cast<const __m256i*>(sub + i);
+			_mm256_storeu_si256(a, _mm256_sub_epi16(_mm256_add_epi16(_mm256_loadu_si256(a), _mm256_load_si256(wa)),
+																	 _mm256_load_si256(ws)));
+		}
+	}
+#endif
+
+	static void add_sub_row(int16_t* acc, const int16_t* add, const int16_t* sub) {
+#if defined(USE_AVX2)
+		if (CPU::HasAvx2) {
+			add_sub_row_avx2(acc, add, sub);
+			return;
+		}
+#endif
+#if defined(USE_SSE2)
+		for (int i = 0; i < HiddenSize; i += 8) {
+			__m128i* a = reinterpret_cast<__m128i*>(acc + i);
+			const __m128i* wa = reinterpret_cast<const __m128i*>(add + i);
+			const __m128i* ws = reinterpret_cast<const __m128i*>(sub + i);
+			_mm_storeu_si128(a, _mm_sub_epi16(_mm_add_epi16(_mm_loadu_si128(a), _mm_load_si128(wa)),
+															_mm_load_si128(ws)));
+		}
+#else
+		for (int i = 0; i < HiddenSize; ++i)
+			acc[i] += add[i] - sub[i];
+#endif
+	}
+
+	// output() computes the dot product of the clipped activations of one
+	// perspective with its half of the output weights.
+#if defined(USE_AVX2)
+	TARGET_AVX2 static int output_avx2(const int16_t* acc, const int8_t* weights) {
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i ones = _mm256_set1_epi16(1);
+		__m256i sum = zero;
+
+		for (int i = 0; i < HiddenSize; i += 32) {
+			__m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+			__m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i + 16));
+
+			// Saturating pack clips to ActivationMax, then the negative half is
+			// cut off. Packing works per 128-bit lane, the permute restores the
+			// order of the activations.
+			__m256i act = _mm256_permute4x64_epi64(_mm256_max_epi8(_mm256_packs_epi16(a0, a1), zero), 0xD8);
+			__m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i));
+
+			// uint8 x int8 products summed in pairs cannot overflow int16, as
+			// 2 * 127 * 127 < 32768.
+			sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(act, w), ones));
+		}
+
+		__m128i sum128 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+		sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0x4E));
+		sum128 = _mm_add_epi32(sum128, _mm_shuffle_epi32(sum128, 0xB1));
+		return _mm_cvtsi128_si32(sum128);
+	}
+#endif
+
+	static int output(const int16_t* acc, const int8_t* weights) {
+#if defined(USE_AVX2)
+		if (CPU::HasAvx2)
+			return output_avx2(acc, weights);
+#endif
+#if defined(USE_SSE2)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i max = _mm_set1_epi16(ActivationMax);
+		__m128i sum = zero;
+
+		for (int i = 0; i < HiddenSize; i += 8) {
+			__m128i act = _mm_min_epi16(_mm_max_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i)), zero), max);
+
+			// Sign extend 8 int8 weights to int16
+			__m128i w = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(weights + i));
+			w = _mm_srai_epi16(_mm_unpacklo_epi8(w, w), 8);
+
+			sum = _mm_add_epi32(sum, _mm_madd_epi16(act, w));
+		}
+
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+		sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+		return _mm_cvtsi128_si32(sum);
+#else
+		int sum = 0;
+
+		for (int i = 0; i < HiddenSize; ++i)
+			sum += std::max(0, std::min(int(acc[i]), ActivationMax)) * weights[i];
+
+		return sum;
+#endif
+	}
+
+	// NNUE::load() reads a network from a file. On success the network is
+	// used from the next search on, if the "Use NNUE" option is set.
+	bool load(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		NetFileHeader header;
+
+		Loaded =  file.read(reinterpret_cast<char*>(&header), sizeof(header))
+			   && !std::memcmp(header.magic, NetFileMagic, sizeof(NetFileMagic))
+			   &&  header.version == NetFileVersion
+			   &&  header.inputSize == InputSize
+			   &&  header.hiddenSize == HiddenSize
+			   &&  file.read(reinterpret_cast<char*>(FeatureBiases), sizeof(FeatureBiases))
+			   &&  file.read(reinterpret_cast<char*>(FeatureWeights), sizeof(FeatureWeights))
+			   &&  file.read(reinterpret_cast<char*>(&OutputBias), sizeof(OutputBias))
+			   &&  file.read(reinterpret_cast<char*>(OutputWeights), sizeof(OutputWeights))
+			   &&  file.peek() == std::ifstream::traits_type::eof();
+
+		Enabled = UseNNUE && Loaded;
+		return Loaded;
+	}
+
+	void use(bool on) {
+		UseNNUE = on;
+		Enabled = UseNNUE && Loaded;
+	}
+
+	// NNUE::refresh() computes the accumulator of a position from scratch
+	void refresh(const Position& pos, Accumulator& acc) {
+		for (Color perspective = WHITE; perspective <= BLACK; ++perspective) {
+			std::memcpy(acc.values[perspective], FeatureBiases, sizeof(FeatureBiases));
+
+			for (Color c = WHITE; c <= BLACK; ++c)
+				for (PieceType pt = PAWN; pt <= KING; ++pt)
+					for (Bitboard b = pos.pieces(c, pt); b; )
+						add_row(acc.values[perspective], feature_row(perspective, c, pt, pop_lsb(&b)));
+		}
+	}
+
+	void add_feature(Accumulator& acc, Color c, PieceType pt, Square s) {
+		add_row(acc.values[WHITE], feature_row(WHITE, c, pt, s));
+		add_row(acc.values[BLACK], feature_row(BLACK, c, pt, s));
+	}
+
+	void remove_feature(Accumulator& acc, Color c, PieceType pt, Square s) {
+		sub_row(acc.values[WHITE], feature_row(WHITE, c, pt, s));
+		sub_row(acc.values[BLACK], feature_row(BLACK, c, pt, s));
+	}
+
+	void move_feature(Accumulator& acc, Color c, PieceType pt, Square from, Square to) {
+		add_sub_row(acc.values[WHITE], feature_row(WHITE, c, pt, to), feature_row(WHITE, c, pt, from));
+		add_sub_row(acc.values[BLACK], feature_row(BLACK, c, pt, to), feature_row(BLACK, c, pt, from));
+	}
+
+	// NNUE::evaluate() returns the network output from the point of view of
+	// the side to move, using the accumulator of the current ply.
+	Value evaluate(const Position& pos) {
+		const Accumulator& acc = pos.accumulator();
+		Color us = pos.side_to_move();
+
+		int64_t sum = OutputBias
+					+ output(acc.values[us], OutputWeights)
+					+ output(acc.values[~us], OutputWeights + HiddenSize);
+
+		int value = int(sum * OutputScale / (ActivationMax * WeightScale));
+
+		return Value(std::max(int(VALUE_MATED_IN_MAX_PLY) + 1, std::min(value, int(VALUE_MATE_IN_MAX_PLY) - 1)));
+	}
+}
\ No newline at end of file
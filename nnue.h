@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "utils/defs.h"
+
+class Position;
+
+namespace NNUE {
+
+	// The network has one input per (piece color, piece type, square), seen
+	// from each side's perspective: "our" pieces come first, and black's board
+	// is flipped vertically. Both perspectives share the feature transformer,
+	// which sums the weights of the active inputs into an accumulator of
+	// HiddenSize int16 values. The clipped accumulators, side to move first,
+	// feed a single int8 output neuron.
+	constexpr int InputSize = 768;
+	constexpr int HiddenSize = 256;
+	constexpr int OutputInputs = 2 * HiddenSize;
+
+	// Quantization. Activations are clipped to [0, ActivationMax], output
+	// weights are scaled by WeightScale, and the output is scaled so that
+	// OutputScale corresponds to one unit of the trained float output.
+	constexpr int ActivationMax = 127;
+	constexpr int WeightScale = 64;
+	constexpr int OutputScale = 400;
+
+	// Accumulator holds the first layer output of both perspectives. Position
+	// keeps one per ply and updates it incrementally as pieces are added,
+	// removed or moved.
+	struct Accumulator {
+		int16_t values[COLOR_NB][HiddenSize];
+	};
+
+	// Enabled is true when the "Use NNUE" option is on and a network is
+	// loaded. Accumulators are updated and used only while it is set.
+	extern bool Enabled;
+
+	bool load(const std::string& path);
+	void use(bool on);
+
+	void refresh(const Position& pos, Accumulator& acc);
+	void add_feature(Accumulator& acc, Color c, PieceType pt, Square s);
+	void remove_feature(Accumulator& acc, Color c, PieceType pt, Square s);
+	void move_feature(Accumulator& acc, Color c, PieceType pt, Square from, Square to);
+
+	Value evaluate(const Position& pos);
+}
\ No newline at end of file
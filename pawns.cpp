@@ -0,0 +1,211 @@
+#include <algorithm>
+
+#include "pawns.h"
+#include "position.h"
+#include "searchcontext.h"
+
+namespace Pawns {
+
+	// Pawn penalties
+	constexpr Value Isolated[PHASE_NB] = { Value(5),  Value(15) };
+	constexpr Value Backward[PHASE_NB] = { Value(9),  Value(24) };
+	constexpr Value Doubled[PHASE_NB]  = { Value(11), Value(56) };
+
+	// PassedRank[Rank] contains a bonus according to the rank of a passed pawn
+	constexpr Value PassedRank[RANK_NB][PHASE_NB] = {
+		{ Value(0),   Value(0)   },
+		{ Value(5),   Value(18)  },
+		{ Value(12),  Value(23)  },
+		{ Value(10),  Value(31)  },
+		{ Value(57),  Value(62)  },
+		{ Value(163), Value(167) },
+		{ Value(271), Value(250) }
+	};
+
+	// PassedFile[File] contains a bonus according to the file of a passed pawn
+	constexpr Value PassedFile[FILE_NB][PHASE_NB] = {
+		{ Value(-1),  Value(7)   },
+		{ Value(0),   Value(9)   },
+		{ Value(-9),  Value(-8)  },
+		{ Value(-30), Value(-14) },
+		{ Value(-30), Value(-14) },
+		{ Value(-9),  Value(-8)  },
+		{ Value(0),   Value(9)   },
+		{ Value(-1),  Value(7)   }
+	};
+
+	// Strength of pawn shelter for our king by [distance from edge][rank].
+	// RANK_1 = 0 is used for files where we have no pawn, or our pawn is behind our king.
+	constexpr int ShelterStrength[FILE_NB / 2][RANK_NB] = {
+		{  -6,  81,  93,  58,  39,  18,   25 },
+		{ -43,  61,  35, -49, -29, -11,  -63 },
+		{ -10,  75,  23,  -2,  32,   3,  -45 },
+		{ -39, -13, -29, -52, -48, -67, -166 }
+	};
+
+	// Danger of enemy pawns moving toward our king by [distance from edge][rank].
+	// RANK_1 = 0 is used for files where the enemy has no pawn, or their pawn
+	// is behind our king.
+	constexpr int UnblockedStorm[FILE_NB / 2][RANK_NB] = {
+		{  89, 107, 123,  93,  57,  45,  51 },
+		{  44, -18, 123,  46,  39,  -7,  23 },
+		{   4,  52, 162,  37,   7, -14,  -2 },
+		{ -10, -14,  90,  15,   2,  -7, -16 }
+	};
+
+	// Pawns::evaluate() scores the pawns of a given color, and fills the pawn
+	// attacks, attack spans and passed pawns of the entry.
+	template<Color Us>
+	void evaluate(const Position& pos, Entry* e) {
+		constexpr Color     Them = (Us == WHITE ? BLACK : WHITE);
+		constexpr Direction Up = (Us == WHITE ? NORTH : SOUTH);
+
+		Bitboard ourPawns = pos.pieces(Us, PAWN);
+		Bitboard theirPawns = pos.pieces(Them, PAWN);
+		Bitboard b = ourPawns;
+		Bitboard neighbours, stoppers, doubled, supported, phalanx, lever, leverPush;
+		bool backward;
+		Square s;
+
+		e->scores[Us][PHASE_MID] = e->scores[Us][PHASE_END] = VALUE_ZERO;
+		e->passedPawns[Us] = e->pawnAttacksSpan[Us] = 0;
+		e->kingSquares[Us] = SQ_NONE;
+		e->pawnAttacks[Us] = pawn_attacks_bb<Us>(ourPawns);
+
+		while (b)
+		{
+			s = pop_lsb(&b);
+			e->pawnAttacksSpan[Us] |= pawn_attack_span(Us, s);
+
+			// Flag the pawn
+			stoppers   = theirPawns & passed_pawn_mask(Us, s);
+			lever      = theirPawns & pos.attacks_from<PAWN>(s, Us);
+			leverPush  = theirPawns & pos.attacks_from<PAWN>(s + Up, Us);
+			doubled    = ourPawns & (s - Up);
+			neighbours = ourPawns & adjacent_files_bb(file_of(s));
+			phalanx    = neighbours & rank_bb(s);
+			supported  = neighbours & rank_bb(s - Up);
+
+			// A pawn is backward when it is behind all pawns of the same color
+			// on the adjacent files and cannot be safely advanced.
+			backward =  !(ourPawns & pawn_attack_span(Them, s + Up))
+					 &&  (stoppers & (leverPush | SquareBB[s + Up]));
+
+			// A pawn is passed when no enemy pawn can stop it, or when the only
+			// stoppers are levers which are outnumbered by our support.
+			if (   !(stoppers ^ lever ^ leverPush)
+				&& popcount(supported) >= popcount(lever) - 1
+				&& popcount(phalanx) >= popcount(leverPush))
+			{
+				e->passedPawns[Us] |= s;
+
+				for (Phase ph = PHASE_MID; ph <= PHASE_END; ++ph)
+					e->scores[Us][ph] += PassedRank[relative_rank(Us, s)][ph] + PassedFile[file_of(s)][ph];
+			}
+
+			for (Phase ph = PHASE_MID; ph <= PHASE_END; ++ph)
+			{
+				if (!neighbours)
+					e->scores[Us][ph] -= Isolated[ph];
+
+				else if (backward && !(supported | phalanx))
+					e->scores[Us][ph] -= Backward[ph];
+
+				if (doubled && !supported)
+					e->scores[Us][ph] -= Doubled[ph];
+			}
+		}
+	}
+
+	// Pawns::probe() looks up the current position's pawn configuration in the
+	// pawn hash table. If it is not found, it is computed and stored in the table.
+	Entry* probe(const Position& pos) {
+		Key key = pos.pawn_key();
+		Entry* e = pos.context().pawns_table()[key];
+
+		if (e->key == key)
+			return e;
+
+		e->key = key;
+		evaluate<WHITE>(pos, e);
+		evaluate<BLACK>(pos, e);
+
+		return e;
+	}
+
+	// evaluate_shelter() calculates the shelter bonus and the storm penalty for
+	// a king, looking at the king file and the two closest files.
+	template<Color Us>
+	Value evaluate_shelter(const Position& pos, Square ksq) {
+		constexpr Color     Them = (Us == WHITE ? BLACK : WHITE);
+		constexpr Direction Down = (Us == WHITE ? SOUTH : NORTH);
+		constexpr Bitboard  BlockRanks = (Us == WHITE ? Rank1BB | Rank2BB : Rank8BB | Rank7BB);
+
+		Bitboard b = pos.pieces(PAWN) & ~forward_ranks_bb(Them, ksq);
+		Bitboard ourPawns = b & pos.pieces(Us);
+		Bitboard theirPawns = b & pos.pieces(Them);
+
+		Value safety = (shift<Down>(theirPawns) & (FileABB | FileHBB) & BlockRanks & ksq) ? Value(374) : Value(5);
+
+		File center = std::max(FILE_B, std::min(FILE_G, file_of(ksq)));
+		for (File f = File(center - 1); f <= File(center + 1); ++f)
+		{
+			b = ourPawns & file_bb(f);
+			Rank ourRank = b ? relative_rank(Us, backmost_sq(Us, b)) : RANK_1;
+
+			b = theirPawns & file_bb(f);
+			Rank theirRank = b ? relative_rank(Us, frontmost_sq(Them, b)) : RANK_1;
+
+			int d = std::min(f, ~f);
+			safety += ShelterStrength[d][ourRank];
+			safety -= (ourRank && ourRank == theirRank - 1) ? 66 * (theirRank == RANK_3)
+															: UnblockedStorm[d][theirRank];
+		}
+
+		return safety;
+	}
+
+	// do_king_safety() calculates the king shelter for the current king square
+	// and castling rights, and caches it in the entry. If the king can still
+	// castle, the better of the current and the castled shelter is used.
+	template<Color Us>
+	void do_king_safety(const Position& pos, Entry* e) {
+		constexpr CastlingRight KingSide  = (Us == WHITE ? WKCA : BKCA);
+		constexpr CastlingRight QueenSide = (Us == WHITE ? WQCA : BQCA);
+
+		Square ksq = pos.king_sq(Us);
+		Bitboard pawns = pos.pieces(Us, PAWN);
+		int minKingPawnDistance = 0;
+
+		e->kingSquares[Us] = ksq;
+		e->castlingRights[Us] = CastlingRight(pos.castling_rights() & (KingSide | QueenSide));
+
+		if (pawns)
+			minKingPawnDistance = 8;
+
+		while (pawns)
+			minKingPawnDistance = std::min(minKingPawnDistance, distance(ksq, pop_lsb(&pawns)));
+
+		Value bonus = evaluate_shelter<Us>(pos, ksq);
+
+		if (pos.can_castle(KingSide))
+			bonus = std::max(bonus, evaluate_shelter<Us>(pos, relative_square(Us, SQ_G1)));
+
+		if (pos.can_castle(QueenSide))
+			bonus = std::max(bonus, evaluate_shelter<Us>(pos, relative_square(Us, SQ_C1)));
+
+		e->kingSafety[Us][PHASE_MID] = bonus;
+		e->kingSafety[Us][PHASE_END] = Value(-16 * minKingPawnDistance);
+	}
+
+	// Entry::king_safety() returns the king shelter, recomputing it only when
+	// the king has moved or the castling rights have changed since it was cached.
+	Value Entry::king_safety(const Position& pos, Color c, Phase ph) {
+		CastlingRight cr = CastlingRight(pos.castling_rights() & (c == WHITE ? WKCA | WQCA : BKCA | BQCA));
+
+		if (kingSquares[c] != pos.king_sq(c) || castlingRights[c] != cr)
+			c == WHITE ? do_king_safety<WHITE>(pos, this) : do_king_safety<BLACK>(pos, this);
+
+		return kingSafety[c][ph];
+	}
+}
\ No newline at end of file
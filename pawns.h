@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include "bitboard.h"
+#include "utils/defs.h"
+
+class Position;
+
+namespace Pawns {
+
+	// Pawns::Entry contains various information about a pawn structure. A lookup
+	// to the pawn hash table (performed by calling the probe function) returns a
+	// pointer to an Entry object.
+	struct Entry {
+		Value pawn_score(Color c, Phase ph) const { return scores[c][ph]; }
+		Bitboard pawn_attacks(Color c) const { return pawnAttacks[c]; }
+		Bitboard passed_pawns(Color c) const { return passedPawns[c]; }
+		Bitboard pawn_attacks_span(Color c) const { return pawnAttacksSpan[c]; }
+
+		Value king_safety(const Position& pos, Color c, Phase ph);
+
+		Key key;
+		Value scores[COLOR_NB][PHASE_NB];
+		Bitboard passedPawns[COLOR_NB];
+		Bitboard pawnAttacks[COLOR_NB];
+		Bitboard pawnAttacksSpan[COLOR_NB];
+
+		// King shelter is cached for the king square and castling rights it was
+		// computed with, the pawns alone don't determine it.
+		Square kingSquares[COLOR_NB];
+		CastlingRight castlingRights[COLOR_NB];
+		Value kingSafety[COLOR_NB][PHASE_NB];
+	};
+
+	// Pawns::Table is the pawn hash table. Each search thread owns one, so that
+	// it is never written by two threads at once. Entries are indexed by the
+	// lower bits of the pawn key.
+	class Table {
+	public:
+		static constexpr int Size = 16384;
+
+		Table() : entries_(Size) {}
+
+		Entry* operator[](Key key) { return &entries_[key & (Size - 1)]; }
+
+	private:
+		std::vector<Entry> entries_;
+	};
+
+	Entry* probe(const Position& pos);
+}
\ No newline at end of file
@@ -1,50 +1,141 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
-#include <random>
 
 #include "position.h"
-#include "movegen.h"
 #include "psqt.h"
-#include "tt.h"
+#include "searchcontext.h"
 #include "utils/typeconvertions.h"
 #include "utils/stringoperators.h"
 
 using namespace std;
 
 namespace Zobrist {
-	std::random_device rd;
-	std::mt19937_64 engine64(rd());
-	std::uniform_int_distribution<Key> dist64(0, UINT64_MAX);
 
-	Key psq[2][7][64]; // color, piecetype, square
-	Key enpassant[8]; // for each file
-	Key castling[16];
-	Key side;
+	// PRNG is a xorshift64star pseudo random number generator, see
+	// vigna.di.unimi.it/ftp/papers/xorshift.pdf. It is constexpr, so that the
+	// keys are drawn by the compiler.
+	class PRNG {
+	public:
+		constexpr PRNG(uint64_t seed) : s(seed) {}
 
-	static Key rand64() {
-		return dist64(engine64);
+		constexpr Key rand64() {
+			s ^= s >> 12, s ^= s << 25, s ^= s >> 27;
+			return s * 2685821657736338717ULL;
+		}
+
+	private:
+		uint64_t s;
+	};
+
+	struct Keys {
+		Key psq[COLOR_NB][PIECETYPE_NB][SQUARE_NB]; // color, piecetype, square
+		Key enpassant[FILE_NB]; // for each file
+		Key castling[16];
+		Key side;
+		Key noPawns;
+	};
+
+	// make_keys() draws the keys from a fixed seed, so they are the same in
+	// every run and saved hash tables stay valid after a restart.
+	constexpr Keys make_keys() {
+		Keys k = {};
+		PRNG rng(1070372);
+
+		for (Color c = WHITE; c <= BLACK; ++c)
+			for (PieceType pt = PIECETYPE_NONE; pt <= KING; ++pt)
+				for (Square s = SQ_A1; s <= SQ_H8; ++s)
+					k.psq[c][pt][s] = rng.rand64();
+
+		for (File f = FILE_A; f <= FILE_H; ++f)
+			k.enpassant[f] = rng.rand64();
+
+		for (int i = 0; i < 16; ++i)
+			k.castling[i] = rng.rand64();
+
+		k.side = rng.rand64();
+		k.noPawns = rng.rand64();
+
+		return k;
 	}
 
-	void init_keys() {
-		for (Color c = WHITE; c < BOTH; ++c) {
-			for (PieceType p = PIECETYPE_NONE; p <= KING; ++p) {
-				for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-					psq[c][p][s] = rand64();
-				}
-			}
-		}
+	constexpr Keys keys = make_keys();
 
-		for (File file = FILE_A; file <= FILE_H; ++file) {
-			enpassant[file] = rand64();
-		}
+	constexpr const auto& psq = keys.psq;
+	constexpr const auto& enpassant = keys.enpassant;
+	constexpr const auto& castling = keys.castling;
+	constexpr Key side = keys.side;
+	constexpr Key noPawns = keys.noPawns;
 
-		for (int i = 0; i < 16; ++i) {
-			castling[i] = rand64();
-		}
+	Key material_key(const int counts[COLOR_NB][PIECETYPE_NB]) {
+		Key key = 0;
 
-		side = rand64();
+		for (Color c = WHITE; c <= BLACK; ++c)
+			for (PieceType pt = PAWN; pt <= KING; ++pt)
+				for (int cnt = 0; cnt < counts[c][pt]; ++cnt)
+					key ^= psq[c][pt][cnt];
+
+		return key;
 	}
 }
 
+// Cuckoo tables of the reversible moves, indexed by the key difference the
+// move makes: the moved piece on both squares and the side to move. A move
+// and its reverse make the same difference and share an entry. Each key sits
+// in one of two slots, given by H1() and H2() of the key.
+namespace Cuckoo {
+	constexpr int Size = 8192;
+
+	struct Tables {
+		Key keys[Size];
+		Move moves[Size];
+	};
+
+	constexpr int H1(Key h) { return h & (Size - 1); }
+	constexpr int H2(Key h) { return (h >> 16) & (Size - 1); }
+
+	// make_tables() inserts every non pawn move on an empty board. An entry
+	// pushed out of its slot moves to its other slot, until an empty one is
+	// reached.
+	constexpr Tables make_tables() {
+		Tables t = {};
+
+		for (Color c = WHITE; c <= BLACK; ++c)
+			for (PieceType pt = KNIGHT; pt <= KING; ++pt)
+				for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1) {
+					Bitboard attacks = pseudo_attacks(pt, s1);
+
+					for (Square s2 = Square(s1 + 1); s2 <= SQ_H8; ++s2)
+						if (attacks & (1ULL << s2)) {
+							Move move = make_move(s1, s2);
+							Key key = Zobrist::psq[c][pt][s1] ^ Zobrist::psq[c][pt][s2] ^ Zobrist::side;
+							int i = H1(key);
+
+							while (true) {
+								Key k = t.keys[i];
+								Move m = t.moves[i];
+
+								t.keys[i] = key, key = k;
+								t.moves[i] = move, move = m;
+
+								if (move == MOVE_NONE)
+									break;
+
+								i = i == H1(key) ? H2(key) : H1(key);
+							}
+						}
+				}
+
+		return t;
+	}
+
+	constexpr Tables tables = make_tables();
+
+	constexpr const auto& keys = tables.keys;
+	constexpr const auto& moves = tables.moves;
+}
+
 const int CastlePerm[64] = {
 	13, 15, 15, 15, 12, 15, 15, 14,
 	15, 15, 15, 15, 15, 15, 15, 15,
@@ -56,22 +147,59 @@ const int CastlePerm[64] = {
 	7,  15, 15, 15,  3, 15, 15, 11
 };
 
-Position::Position() {
+Position::Position(SearchContext& ctx)
+	: ctx_(&ctx), st_(ctx.states_.data()), acc_(ctx.accumulators_.data()) {
+}
+
+// Position::Position() copies a position into another context, for a search
+// thread to play on its own stacks. The game history is copied along with
+// the board, it is needed to detect repetitions.
+Position::Position(const Position& pos, SearchContext& ctx)
+	: Position(pos) {
+
+	ctx_ = &ctx;
+	reserve(hisPly_);
+	st_ = ctx.states_.data() + hisPly_;
+	acc_ = ctx.accumulators_.data() + hisPly_;
 
+	std::copy(pos.st_ - hisPly_, pos.st_ + 1, ctx.states_.data());
+	*acc_ = *pos.acc_;
 }
 
 Bitboard Position::attackers_to(Square s, Bitboard occ) const {
-	return (attacks_from<PAWN>(s, BLACK) & OccupiedBB[WHITE][PAWN])
-		| (attacks_from<PAWN>(s, WHITE)  & OccupiedBB[BLACK][PAWN])
-		| (attacks_from<KNIGHT>(s)       & OccupiedBB[BOTH][KNIGHT])
-		| (attacks_bb<  ROOK>(s, occ)	 & (OccupiedBB[BOTH][ROOK] | OccupiedBB[BOTH][QUEEN]))
-		| (attacks_bb<BISHOP>(s, occ)	 & (OccupiedBB[BOTH][BISHOP] | OccupiedBB[BOTH][QUEEN]))
-		| (attacks_from<KING>(s)         & OccupiedBB[BOTH][KING]);
+	return (attacks_from<PAWN>(s, BLACK) & occupiedBB_[WHITE][PAWN])
+		| (attacks_from<PAWN>(s, WHITE)  & occupiedBB_[BLACK][PAWN])
+		| (attacks_from<KNIGHT>(s)       & occupiedBB_[BOTH][KNIGHT])
+		| (attacks_bb<  ROOK>(s, occ)	 & (occupiedBB_[BOTH][ROOK] | occupiedBB_[BOTH][QUEEN]))
+		| (attacks_bb<BISHOP>(s, occ)	 & (occupiedBB_[BOTH][BISHOP] | occupiedBB_[BOTH][QUEEN]))
+		| (attacks_from<KING>(s)         & occupiedBB_[BOTH][KING]);
 }
 
+// Position::reserve() grows the state and accumulator stacks, so that they
+// hold a game of the given number of plies and a full search after it. The
+// stacks are reallocated, so the current frames are looked up again.
+void Position::reserve(int gamePlies) {
+	size_t size = size_t(gamePlies) + DEPTH_MAX + 1;
+
+	if (ctx_->states_.size() >= size)
+		return;
+
+	ctx_->states_.resize(size);
+	ctx_->accumulators_.resize(size);
+	st_ = ctx_->states_.data() + hisPly_;
+	acc_ = ctx_->accumulators_.data() + hisPly_;
+}
+
+// Position::set() sets up the position described by the given FEN string. It
+// starts a new game, so the state stack is reset to its first frame.
 void Position::set(string fen) {
-	fen_ = fen;
+	const string fullFen = fen;
+
 	clear_pieces();
+	hisPly_ = ply_ = 0;
+	st_ = ctx_->states_.data();
+	acc_ = ctx_->accumulators_.data();
+	*st_ = StateInfo();
 
 	size_t pos = 0;
 	for (Rank r = RANK_8; r >= RANK_1; --r) {
@@ -93,86 +221,314 @@ void Position::set(string fen) {
 		}
 	}
 
-	fen = fen_;
+	fen = fullFen;
 	string fenDetails = fen.substr(fen.find(" "));
 	stringoperators::trim(fenDetails);
 	vector<string> details = stringoperators::split(fenDetails, ' ');
 
+	StateInfo* st = state();
 	sideToMove_ =  details.at(0) == "w" ? WHITE : BLACK;
-	castlingRights_ = details.at(1).find("K") != std::string::npos ? WKCA : NO_CASTLING;
-	castlingRights_ += details.at(1).find("Q") != std::string::npos ? WQCA : NO_CASTLING;
-	castlingRights_ += details.at(1).find("k") != std::string::npos ? BKCA : NO_CASTLING;
-	castlingRights_ += details.at(1).find("q") != std::string::npos ? BQCA : NO_CASTLING;
-	enPassant_ = details.at(2) == "-" ? SQ_NONE : TypeConvertions::str_to_sq(details.at(2));
+	st->castlingRights = details.at(1).find("K") != std::string::npos ? WKCA : NO_CASTLING;
+	st->castlingRights += details.at(1).find("Q") != std::string::npos ? WQCA : NO_CASTLING;
+	st->castlingRights += details.at(1).find("k") != std::string::npos ? BKCA : NO_CASTLING;
+	st->castlingRights += details.at(1).find("q") != std::string::npos ? BQCA : NO_CASTLING;
+	st->enPassant = details.at(2) == "-" ? SQ_NONE : TypeConvertions::str_to_sq(details.at(2));
 	calculate_pos_key();
+	set_check_info();
+	refresh_accumulator();
 }
 
-void Position::best_move_set(Move m) {
-	bestMoveRoot_ = m;
+// Position::refresh_accumulator() computes the NNUE accumulator of the current
+// ply from scratch. It is needed after the position is set up, and when the
+// network is enabled or loaded with a position already set up.
+void Position::refresh_accumulator() {
+	if (NNUE::Enabled)
+		NNUE::refresh(*this, *acc_);
 }
 
-Move Position::best_move() const {
-	return bestMoveRoot_;
-}
+// Position::set_check_info() computes the pieces giving check to the side to
+// move, and our pieces pinned to our king. Done once per node, so that move
+// generation and legality checks don't need to recompute them.
+void Position::set_check_info() {
+	StateInfo* st = state();
+	Color us = sideToMove_;
+	Color them = ~us;
+	Square ksq = kingSq_[us];
 
-void Position::print_pv() {
-	TTEntry* ttEntry;
-	bool ttHit;
-	Move move = bestMoveRoot_; // Root move saved here
-	int pvCount = 0 ;
+	st->checkers = attackers_to(ksq) & pieces(them);
+	st->pinned = 0;
 
-	do 
-	{
-		std::cout << TypeConvertions::move_to_string(move) << " ";
-		do_move(move);
+	// Enemy sliders which would attack our king on an empty board
+	Bitboard snipers = ((attacks_bb<  ROOK>(ksq, 0) & (pieces(them, ROOK) | pieces(them, QUEEN)))
+					 |  (attacks_bb<BISHOP>(ksq, 0) & (pieces(them, BISHOP) | pieces(them, QUEEN))));
+
+	while (snipers) {
+		Bitboard b = between_bb(ksq, pop_lsb(&snipers)) & pieces();
 
-		// Check for position in tt
-		ttEntry = TT.probe(posKey_, ttHit);
-		move = ttEntry->move;
+		if (b && !more_than_one(b))
+			st->pinned |= b & pieces(us);
+	}
+}
 
-		++pvCount;
+// Position::print_pv() prints the principal variation of the last completed
+// iteration, taken from the triangular PV table of the search.
+void Position::print_pv() const {
+	const Move* pv = ctx_->pv();
 
-	} while (ttHit
-		&&   ttEntry->bound == BOUND_EXACT
-		&&   is_real_move(move));
+	for (int i = 0; i < ctx_->pv_length(); ++i)
+		std::cout << TypeConvertions::move_to_string(pv[i]) << " ";
 
 	std::cout << std::endl;
+}
 
-	while (pvCount > 0)
-	{
-		undo_move();
-		--pvCount;
+// Position::pseudo_legal() takes a random move and tests whether the move is
+// pseudo legal. It is used to validate moves from the TT and killer moves
+// before trying them, so that no move generation is needed for them.
+bool Position::pseudo_legal(const Move m) const {
+	Color us = sideToMove_;
+	Square from = from_sq(m);
+	Square to = to_sq(m);
+	PieceType pt = moved_piece(m);
+
+	if (m == MOVE_NONE || from == to)
+		return false;
+
+	// The moved piece must be ours
+	if (!(pieces(us) & from))
+		return false;
+
+	// Only promotions carry a promotion piece, so that a move has exactly one
+	// encoding
+	if (type_of(m) != PROMOTION && (m & (3 << 12)))
+		return false;
+
+	if (type_of(m) == CASTLING) {
+		Square ksq = us == WHITE ? SQ_E1 : SQ_E8;
+		bool kingSide = file_of(to) == FILE_G;
+		CastlingRight cr = us == WHITE ? (kingSide ? WKCA : WQCA)
+									   : (kingSide ? BKCA : BQCA);
+
+		if (   pt != KING
+			|| from != ksq
+			|| rank_of(to) != rank_of(ksq)
+			|| (file_of(to) != FILE_G && file_of(to) != FILE_C)
+			|| !can_castle(cr))
+			return false;
+
+		// Squares between king and rook must be empty, and the king may not
+		// be in check or pass through an attacked square.
+		Bitboard between = kingSide ? SquareBB[ksq + EAST] | SquareBB[ksq + 2 * EAST]
+									: SquareBB[ksq + WEST] | SquareBB[ksq + 2 * WEST] | SquareBB[ksq + 3 * WEST];
+		Square pass = kingSide ? ksq + EAST : ksq + WEST;
+
+		return !(between & pieces())
+			&& !(attackers_to(ksq) & pieces(~us))
+			&& !(attackers_to(pass) & pieces(~us));
 	}
+
+	// En passant is only possible to the current en passant square
+	if (type_of(m) == ENPASSANT)
+		return pt == PAWN
+			&& to == en_passant()
+			&& (attacks_from<PAWN>(from, us) & to);
+
+	// We may not capture our own pieces
+	if (pieces(us) & to)
+		return false;
+
+	if (pt == PAWN) {
+		Direction up = us == WHITE ? NORTH : SOUTH;
+		bool lastRank = rank_of(to) == (us == WHITE ? RANK_8 : RANK_1);
+
+		// Pawns promote exactly when reaching the last rank
+		if (lastRank != (type_of(m) == PROMOTION))
+			return false;
+
+		if (pieces(~us) & to)
+			return attacks_from<PAWN>(from, us) & to;
+
+		if (to == from + up + up)
+			return rank_of(from) == (us == WHITE ? RANK_2 : RANK_7)
+				&& pieces_[from + up] == PIECETYPE_NONE;
+
+		return to == from + up;
+	}
+
+	return type_of(m) == NORMAL
+		&& (attacks_from(pt, from) & to);
 }
 
-bool Position::is_real_move(Move move) {
-	Movelist list = Movelist();
-	Movegen::get_moves(*this, list);
+// Position::legal() tests whether a pseudo legal move is legal, that is the
+// move does not leave our own king in check.
+bool Position::legal(const Move m) const {
+	Color us = sideToMove_;
+	Color them = ~us;
+	Square from = from_sq(m);
+	Square to = to_sq(m);
+	Square ksq = kingSq_[us];
+
+	// En passant may uncover the king along the rank of the captured pawn,
+	// so simply test the position after the move.
+	if (type_of(m) == ENPASSANT) {
+		Square capsq = to + (us == WHITE ? SOUTH : NORTH);
+		Bitboard occ = (pieces() ^ from ^ capsq) | to;
+
+		return !(attackers_to(ksq, occ) & pieces(them) & ~SquareBB[capsq]);
+	}
 
-	for (int moveNum = 0; moveNum < list.count; ++moveNum)
-		if (list.moves[moveNum].move == move) {
-			if (!do_move(move)) return false;
-			undo_move();
-			
-			return true;
-		}
+	// The king may not move to an attacked square. Castling squares the king
+	// passes are checked in pseudo_legal().
+	if (from == ksq)
+		return !(attackers_to(to, pieces() ^ from) & pieces(them));
 
-	return false;
+	// In check, a non king move must capture the checker or block the check
+	if (checkers()) {
+		if (more_than_one(checkers()))
+			return false;
+
+		if (!((between_bb(ksq, lsb(checkers())) | checkers()) & to))
+			return false;
+	}
+
+	// A pinned piece may only move along the pin line
+	return !(pinned() & from) || aligned(from, to, ksq);
 }
 
-bool Position::is_repetition() {
-	int index = 0;
+// Position::see() tests if the static exchange evaluation of a move is greater
+// than or equal to the given threshold. The exchange on the destination square
+// is played out with the least valuable attacker first, and sliders hidden
+// behind the capturing pieces join in as x-ray attackers.
+bool Position::see(const Move m, Value threshold) const {
+	using PSQT::PieceValue;
 
-	for (index = hisPly_ - fiftyMove_; index < hisPly_ - 1; ++index) {
-		if (posKey_ == history_[index].posKey) {
-			return true;
+	// Castling, en passant and promotions are assumed to pass a simple SEE
+	if (type_of(m) != NORMAL)
+		return VALUE_ZERO >= threshold;
+
+	Square from = from_sq(m);
+	Square to = to_sq(m);
+
+	int swap = PieceValue[PHASE_MID][pieces_[to]] - threshold;
+	if (swap < 0)
+		return false;
+
+	swap = PieceValue[PHASE_MID][pieces_[from]] - swap;
+	if (swap <= 0)
+		return true;
+
+	Bitboard occ = pieces() ^ from ^ to;
+	Bitboard attackers = attackers_to(to, occ);
+	Bitboard stmAttackers, bb;
+	Color stm = sideToMove_;
+	int res = 1;
+
+	while (true)
+	{
+		stm = ~stm;
+		attackers &= occ;
+
+		// If stm has no more attackers then give up: stm loses
+		if (!(stmAttackers = attackers & pieces(stm)))
+			break;
+
+		res ^= 1;
+
+		// Locate and remove the next least valuable attacker, and add to
+		// the bitboard 'attackers' any X-ray attackers behind it.
+		if ((bb = stmAttackers & pieces(PAWN)))
+		{
+			if ((swap = PawnValueMg - swap) < res)
+				break;
+
+			occ ^= lsb(bb);
+			attackers |= attacks_bb<BISHOP>(to, occ) & (pieces(BISHOP) | pieces(QUEEN));
+		}
+
+		else if ((bb = stmAttackers & pieces(KNIGHT)))
+		{
+			if ((swap = KnightValueMg - swap) < res)
+				break;
+
+			occ ^= lsb(bb);
+		}
+
+		else if ((bb = stmAttackers & pieces(BISHOP)))
+		{
+			if ((swap = BishopValueMg - swap) < res)
+				break;
+
+			occ ^= lsb(bb);
+			attackers |= attacks_bb<BISHOP>(to, occ) & (pieces(BISHOP) | pieces(QUEEN));
+		}
+
+		else if ((bb = stmAttackers & pieces(ROOK)))
+		{
+			if ((swap = RookValueMg - swap) < res)
+				break;
+
+			occ ^= lsb(bb);
+			attackers |= attacks_bb<ROOK>(to, occ) & (pieces(ROOK) | pieces(QUEEN));
 		}
+
+		else if ((bb = stmAttackers & pieces(QUEEN)))
+		{
+			if ((swap = QueenValueMg - swap) < res)
+				break;
+
+			occ ^= lsb(bb);
+			attackers |= (attacks_bb<BISHOP>(to, occ) & (pieces(BISHOP) | pieces(QUEEN)))
+					   | (attacks_bb<ROOK  >(to, occ) & (pieces(ROOK) | pieces(QUEEN)));
+		}
+
+		else // KING
+			 // If we "capture" with the king but opponent still has attackers,
+			 // reverse the result.
+			return (attackers & ~pieces(stm)) ? res ^ 1 : res;
 	}
+
+	return bool(res);
+}
+
+// Position::is_repetition() tests whether the current position occurred
+// before. Only positions since the last irreversible move and the last null
+// move can repeat it, with the same side to move, so every second of them is
+// tested starting four plies back.
+bool Position::is_repetition() const {
+	int end = std::min(st_->fiftyMove, st_->pliesFromNull);
+
+	for (int i = 4; i <= end; i += 2)
+		if ((st_ - i)->posKey == st_->posKey)
+			return true;
+
 	return false;
 }
 
-const string Position::fen() const {
-	return fen_;
+// Position::has_game_cycle() tests whether the side to move has a reversible
+// move to a position which occurred before, so that it can at least draw by
+// repetition. The key difference to each earlier position with the other side
+// to move is looked up in the cuckoo tables, and a match is a move if the
+// piece on one of its squares is ours and the path to the other is free.
+bool Position::has_game_cycle() const {
+	int end = std::min(st_->fiftyMove, st_->pliesFromNull);
+	int j;
+
+	for (int i = 3; i <= end; i += 2) {
+		Key moveKey = st_->posKey ^ (st_ - i)->posKey;
+
+		if (   (j = Cuckoo::H1(moveKey), Cuckoo::keys[j] == moveKey)
+			|| (j = Cuckoo::H2(moveKey), Cuckoo::keys[j] == moveKey))
+		{
+			Move move = Cuckoo::moves[j];
+			Square s1 = from_sq(move);
+			Square s2 = to_sq(move);
+
+			if (   !(between_bb(s1, s2) & pieces())
+				&&  (pieces(sideToMove_) & (pieces_[s1] ? s1 : s2)))
+				return true;
+		}
+	}
+
+	return false;
 }
 
 void Position::print() const {
@@ -194,8 +550,8 @@ void Position::print() const {
 		}
 		std::cout << std::endl;
 	}
-	std::cout << "Key: " << posKey_ << std::endl;
-	std::cout << "Bestmove: " << TypeConvertions::move_to_string(bestMoveRoot_) << std::endl;
+	std::cout << "Key: " << pos_key() << std::endl;
+	std::cout << "Bestmove: " << TypeConvertions::move_to_string(ctx_->best_move()) << std::endl;
 
 	std::cout << std::endl;
 }
@@ -212,69 +568,69 @@ void Position::add_piece(Piece pc, Square s) {
 }
 
 void Position::add_pawn(Color c, Square s) {
-	OccupiedBB[c][PAWN] |= SquareBB[s];
-	OccupiedBB[BOTH][PAWN] |= SquareBB[s];
-	OccupiedBB[c][PIECETYPE_ANY] |= SquareBB[s];
-	OccupiedBB[BOTH][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[c][PAWN] |= SquareBB[s];
+	occupiedBB_[BOTH][PAWN] |= SquareBB[s];
+	occupiedBB_[c][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[BOTH][PIECETYPE_ANY] |= SquareBB[s];
 
 	pieces_[s] = PAWN;
-	psq_[PHASE_MID] += c == WHITE ? PawnValueMg : -PawnValueMg;
-	psq_[PHASE_END] += c == WHITE ? PawnValueEg : -PawnValueEg;
+	state()->psq[PHASE_MID] += c == WHITE ? PawnValueMg : -PawnValueMg;
+	state()->psq[PHASE_END] += c == WHITE ? PawnValueEg : -PawnValueEg;
 }
 
 void Position::add_knight(Color c, Square s) {
-	OccupiedBB[c][KNIGHT] |= SquareBB[s];
-	OccupiedBB[BOTH][KNIGHT] |= SquareBB[s];
-	OccupiedBB[c][PIECETYPE_ANY] |= SquareBB[s];
-	OccupiedBB[BOTH][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[c][KNIGHT] |= SquareBB[s];
+	occupiedBB_[BOTH][KNIGHT] |= SquareBB[s];
+	occupiedBB_[c][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[BOTH][PIECETYPE_ANY] |= SquareBB[s];
 
 	pieces_[s] = KNIGHT;
-	psq_[PHASE_MID] += c == WHITE ? KnightValueMg : -KnightValueMg;
-	psq_[PHASE_END] += c == WHITE ? KnightValueEg : -KnightValueEg;
-	nonPawnMaterial_[c] += KnightValueMg;
+	state()->psq[PHASE_MID] += c == WHITE ? KnightValueMg : -KnightValueMg;
+	state()->psq[PHASE_END] += c == WHITE ? KnightValueEg : -KnightValueEg;
+	state()->nonPawnMaterial[c] += KnightValueMg;
 }
 
 void Position::add_bishop(Color c, Square s) {
-	OccupiedBB[c][BISHOP] |= SquareBB[s];
-	OccupiedBB[BOTH][BISHOP] |= SquareBB[s];
-	OccupiedBB[c][PIECETYPE_ANY] |= SquareBB[s];
-	OccupiedBB[BOTH][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[c][BISHOP] |= SquareBB[s];
+	occupiedBB_[BOTH][BISHOP] |= SquareBB[s];
+	occupiedBB_[c][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[BOTH][PIECETYPE_ANY] |= SquareBB[s];
 
 	pieces_[s] = BISHOP;
-	psq_[PHASE_MID] += c == WHITE ? BishopValueMg : -BishopValueMg;
-	psq_[PHASE_END] += c == WHITE ? BishopValueEg : -BishopValueEg;
-	nonPawnMaterial_[c] += BishopValueMg;
+	state()->psq[PHASE_MID] += c == WHITE ? BishopValueMg : -BishopValueMg;
+	state()->psq[PHASE_END] += c == WHITE ? BishopValueEg : -BishopValueEg;
+	state()->nonPawnMaterial[c] += BishopValueMg;
 }
 
 void Position::add_rook(Color c, Square s) {
-	OccupiedBB[c][ROOK] |= SquareBB[s];
-	OccupiedBB[BOTH][ROOK] |= SquareBB[s];
-	OccupiedBB[c][PIECETYPE_ANY] |= SquareBB[s];
-	OccupiedBB[BOTH][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[c][ROOK] |= SquareBB[s];
+	occupiedBB_[BOTH][ROOK] |= SquareBB[s];
+	occupiedBB_[c][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[BOTH][PIECETYPE_ANY] |= SquareBB[s];
 
 	pieces_[s] = ROOK;
-	psq_[PHASE_MID] += c == WHITE ? RookValueMg : -RookValueMg;
-	psq_[PHASE_END] += c == WHITE ? RookValueEg : -RookValueEg;
-	nonPawnMaterial_[c] += RookValueMg;
+	state()->psq[PHASE_MID] += c == WHITE ? RookValueMg : -RookValueMg;
+	state()->psq[PHASE_END] += c == WHITE ? RookValueEg : -RookValueEg;
+	state()->nonPawnMaterial[c] += RookValueMg;
 }
 
 void Position::add_queen(Color c, Square s) {
-	OccupiedBB[c][QUEEN] |= SquareBB[s];
-	OccupiedBB[BOTH][QUEEN] |= SquareBB[s];
-	OccupiedBB[c][PIECETYPE_ANY] |= SquareBB[s];
-	OccupiedBB[BOTH][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[c][QUEEN] |= SquareBB[s];
+	occupiedBB_[BOTH][QUEEN] |= SquareBB[s];
+	occupiedBB_[c][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[BOTH][PIECETYPE_ANY] |= SquareBB[s];
 
 	pieces_[s] = QUEEN;
-	psq_[PHASE_MID] += c == WHITE ? QueenValueMg : -QueenValueMg;
-	psq_[PHASE_END] += c == WHITE ? QueenValueEg : -QueenValueEg;
-	nonPawnMaterial_[c] += QueenValueMg;
+	state()->psq[PHASE_MID] += c == WHITE ? QueenValueMg : -QueenValueMg;
+	state()->psq[PHASE_END] += c == WHITE ? QueenValueEg : -QueenValueEg;
+	state()->nonPawnMaterial[c] += QueenValueMg;
 }
 
 void Position::add_king(Color c, Square s) {
-	OccupiedBB[c][KING] |= SquareBB[s];
-	OccupiedBB[BOTH][KING] |= SquareBB[s];
-	OccupiedBB[c][PIECETYPE_ANY] |= SquareBB[s];
-	OccupiedBB[BOTH][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[c][KING] |= SquareBB[s];
+	occupiedBB_[BOTH][KING] |= SquareBB[s];
+	occupiedBB_[c][PIECETYPE_ANY] |= SquareBB[s];
+	occupiedBB_[BOTH][PIECETYPE_ANY] |= SquareBB[s];
 
 	kingSq_[c] = s;
 	pieces_[s] = KING;
@@ -282,69 +638,110 @@ void Position::add_king(Color c, Square s) {
 
 void Position::clear_pieces() {
 	for (Color c = WHITE; c <= BOTH; ++c) {
-		OccupiedBB[c][PAWN] = 0;
-		OccupiedBB[c][KNIGHT] = 0;
-		OccupiedBB[c][BISHOP] = 0;
-		OccupiedBB[c][ROOK] = 0;
-		OccupiedBB[c][QUEEN] = 0;
-		OccupiedBB[c][KING] = 0;
-		OccupiedBB[c][PIECETYPE_ANY] = 0;
+		occupiedBB_[c][PAWN] = 0;
+		occupiedBB_[c][KNIGHT] = 0;
+		occupiedBB_[c][BISHOP] = 0;
+		occupiedBB_[c][ROOK] = 0;
+		occupiedBB_[c][QUEEN] = 0;
+		occupiedBB_[c][KING] = 0;
+		occupiedBB_[c][PIECETYPE_ANY] = 0;
 	}
 
 	for (Square sq = SQ_A1; sq <= SQ_H8; ++sq)
 		pieces_[sq] = PIECETYPE_NONE;
-
-	for (Phase p = PHASE_MID; p <= PHASE_END; ++p)
-		psq_[p] = VALUE_ZERO;
-
-	for (Color c = WHITE; c <= BLACK; ++c)
-		nonPawnMaterial_[COLOR_NB] = VALUE_ZERO;
 }
 
 Piece Position::piece_at_square(Square sq) const {
-	if (!(SquareBB[sq] & OccupiedBB[BOTH][PIECETYPE_ANY])) return EMPTY;
-	if (SquareBB[sq] & OccupiedBB[WHITE][PAWN]) return wP;
-	if (SquareBB[sq] & OccupiedBB[BLACK][PAWN]) return bP;
-	if (SquareBB[sq] & OccupiedBB[WHITE][KNIGHT]) return wN;
-	if (SquareBB[sq] & OccupiedBB[BLACK][KNIGHT]) return bN;
-	if (SquareBB[sq] & OccupiedBB[WHITE][BISHOP]) return wB;
-	if (SquareBB[sq] & OccupiedBB[BLACK][BISHOP]) return bB;
-	if (SquareBB[sq] & OccupiedBB[WHITE][ROOK]) return wR;
-	if (SquareBB[sq] & OccupiedBB[BLACK][ROOK]) return bR;
-	if (SquareBB[sq] & OccupiedBB[WHITE][QUEEN]) return wQ;
-	if (SquareBB[sq] & OccupiedBB[BLACK][QUEEN]) return bQ;
-	if (SquareBB[sq] & OccupiedBB[WHITE][KING]) return wK;
-	if (SquareBB[sq] & OccupiedBB[BLACK][KING]) return bK;
+	if (!(SquareBB[sq] & occupiedBB_[BOTH][PIECETYPE_ANY])) return EMPTY;
+	if (SquareBB[sq] & occupiedBB_[WHITE][PAWN]) return wP;
+	if (SquareBB[sq] & occupiedBB_[BLACK][PAWN]) return bP;
+	if (SquareBB[sq] & occupiedBB_[WHITE][KNIGHT]) return wN;
+	if (SquareBB[sq] & occupiedBB_[BLACK][KNIGHT]) return bN;
+	if (SquareBB[sq] & occupiedBB_[WHITE][BISHOP]) return wB;
+	if (SquareBB[sq] & occupiedBB_[BLACK][BISHOP]) return bB;
+	if (SquareBB[sq] & occupiedBB_[WHITE][ROOK]) return wR;
+	if (SquareBB[sq] & occupiedBB_[BLACK][ROOK]) return bR;
+	if (SquareBB[sq] & occupiedBB_[WHITE][QUEEN]) return wQ;
+	if (SquareBB[sq] & occupiedBB_[BLACK][QUEEN]) return bQ;
+	if (SquareBB[sq] & occupiedBB_[WHITE][KING]) return wK;
+	if (SquareBB[sq] & occupiedBB_[BLACK][KING]) return bK;
 	return EMPTY;
 }
 
 void Position::calculate_pos_key() {
-	posKey_ = 0;
+	StateInfo* st = state();
+
+	st->posKey = 0;
+	st->pawnKey = Zobrist::noPawns;
+	st->materialKey = 0;
 
 	for (int sq = 0; sq < 64; ++sq)
-		if (!((OccupiedBB[BOTH][PIECETYPE_ANY] >> sq) & 1)) continue; // empty square
-		else if (((OccupiedBB[WHITE][PAWN] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[WHITE][PAWN][sq];
-		else if (((OccupiedBB[BLACK][PAWN] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[BLACK][PAWN][sq];
-		else if (((OccupiedBB[WHITE][KNIGHT] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[WHITE][KNIGHT][sq];
-		else if (((OccupiedBB[BLACK][KNIGHT] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[BLACK][KNIGHT][sq];
-		else if (((OccupiedBB[WHITE][BISHOP] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[WHITE][BISHOP][sq];
-		else if (((OccupiedBB[BLACK][BISHOP] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[BLACK][BISHOP][sq];
-		else if (((OccupiedBB[WHITE][ROOK] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[WHITE][ROOK][sq];
-		else if (((OccupiedBB[BLACK][ROOK] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[BLACK][ROOK][sq];
-		else if (((OccupiedBB[WHITE][QUEEN] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[WHITE][QUEEN][sq];
-		else if (((OccupiedBB[BLACK][QUEEN] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[BLACK][QUEEN][sq];
-		else if (((OccupiedBB[WHITE][KING] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[WHITE][KING][sq];
-		else if (((OccupiedBB[BLACK][KING] >> sq) & 1) == 1) posKey_ ^= Zobrist::psq[BLACK][KING][sq];
-
-	if (enPassant_ != SQ_NONE)
-		posKey_ ^= Zobrist::enpassant[enPassant_ & 7];
+		if (!((occupiedBB_[BOTH][PIECETYPE_ANY] >> sq) & 1)) continue; // empty square
+		else if (((occupiedBB_[WHITE][PAWN] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[WHITE][PAWN][sq];
+		else if (((occupiedBB_[BLACK][PAWN] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[BLACK][PAWN][sq];
+		else if (((occupiedBB_[WHITE][KNIGHT] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[WHITE][KNIGHT][sq];
+		else if (((occupiedBB_[BLACK][KNIGHT] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[BLACK][KNIGHT][sq];
+		else if (((occupiedBB_[WHITE][BISHOP] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[WHITE][BISHOP][sq];
+		else if (((occupiedBB_[BLACK][BISHOP] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[BLACK][BISHOP][sq];
+		else if (((occupiedBB_[WHITE][ROOK] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[WHITE][ROOK][sq];
+		else if (((occupiedBB_[BLACK][ROOK] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[BLACK][ROOK][sq];
+		else if (((occupiedBB_[WHITE][QUEEN] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[WHITE][QUEEN][sq];
+		else if (((occupiedBB_[BLACK][QUEEN] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[BLACK][QUEEN][sq];
+		else if (((occupiedBB_[WHITE][KING] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[WHITE][KING][sq];
+		else if (((occupiedBB_[BLACK][KING] >> sq) & 1) == 1) st->posKey ^= Zobrist::psq[BLACK][KING][sq];
+
+	for (Bitboard b = occupiedBB_[BOTH][PAWN]; b; ) {
+		Square s = pop_lsb(&b);
+		st->pawnKey ^= Zobrist::psq[occupiedBB_[WHITE][PAWN] & s ? WHITE : BLACK][PAWN][s];
+	}
+
+	// The material key hashes the piece counts, the n-th piece of a type
+	// uses the key of square n.
+	for (Color c = WHITE; c <= BLACK; ++c)
+		for (PieceType pt = PAWN; pt <= KING; ++pt)
+			for (int cnt = 0; cnt < popcount(occupiedBB_[c][pt]); ++cnt)
+				st->materialKey ^= Zobrist::psq[c][pt][cnt];
+
+	if (st->enPassant != SQ_NONE)
+		st->posKey ^= Zobrist::enpassant[st->enPassant & 7];
 	
-	posKey_ ^= Zobrist::castling[castlingRights_];
+	st->posKey ^= Zobrist::castling[st->castlingRights];
 	
-	if (sideToMove_) posKey_ ^= Zobrist::side;
+	if (sideToMove_) st->posKey ^= Zobrist::side;
+}
+
+// Position::key_after() computes the new hash key after the given move. It
+// is used to prefetch the child's TT entry before the move is made.
+Key Position::key_after(const Move m) const {
+	const StateInfo* st = state();
+	Square from = from_sq(m);
+	Square to = to_sq(m);
+	Color us = sideToMove_;
+	PieceType pt = moved_piece(m);
+	PieceType capt = captured_piece(m);
+	PieceType prom = promoted_piece(m);
+	Key k = st->posKey ^ Zobrist::side;
+
+	if (st->enPassant != SQ_NONE) k ^= Zobrist::enpassant[st->enPassant & 7];
+	if (pt == PAWN && (int(to) ^ int(from)) == 16) k ^= Zobrist::enpassant[from & 7];
+
+	k ^= Zobrist::castling[st->castlingRights]
+	   ^ Zobrist::castling[st->castlingRights & CastlePerm[from] & CastlePerm[to]];
+
+	if (capt)
+		k ^= Zobrist::psq[~us][capt][to];
+	else if (type_of(m) == ENPASSANT)
+		k ^= Zobrist::psq[~us][PAWN][us == WHITE ? to + SOUTH : to + NORTH];
+	else if (type_of(m) == CASTLING) {
+		Square rfrom = to > from ? to + EAST : to + 2 * WEST;
+		Square rto = to > from ? to + WEST : to + EAST;
+		k ^= Zobrist::psq[us][ROOK][rfrom] ^ Zobrist::psq[us][ROOK][rto];
+	}
+
+	return k ^ Zobrist::psq[us][pt][from] ^ Zobrist::psq[us][prom ? prom : pt][to];
 }
 
-bool Position::do_move(const Move move) {
+void Position::do_move(const Move move) {
 	Square from = from_sq(move);
 	Square to = to_sq(move);
 	Color side = sideToMove_;
@@ -352,9 +749,25 @@ bool Position::do_move(const Move move) {
 	PieceType capt = captured_piece(move);
 	PieceType prom = promoted_piece(move);
 
-	history_[hisPly_].posKey = posKey_;
+	// Copy the incrementally updated fields to the next frame, the others
+	// are set below.
+	StateInfo* st = state() + 1;
+	std::memcpy(st, state(), offsetof(StateInfo, move));
 
-	if (move & FLAG_EP) {
+	// The move updates a copy of the accumulator, undo_move() just goes back
+	// to the previous one.
+	if (NNUE::Enabled)
+		acc_[1] = acc_[0];
+
+	st_ = st;
+	++acc_;
+	++hisPly_;
+	++ply_;
+
+	st->move = move;
+	st->capturedPiece = type_of(move) == ENPASSANT ? PAWN : capt;
+
+	if (type_of(move) == ENPASSANT) {
 		if (side == WHITE) {
 			clear_piece(to + SOUTH, BLACK);
 		}
@@ -362,7 +775,7 @@ bool Position::do_move(const Move move) {
 			clear_piece(to + NORTH, WHITE);
 		}
 	}
-	else if (move & FLAG_CASTLE) {
+	else if (type_of(move) == CASTLING) {
 		switch (to) {
 		case SQ_C1: move_piece(SQ_A1, SQ_D1, WHITE); break;
 		case SQ_G1: move_piece(SQ_H1, SQ_F1, WHITE); break;
@@ -373,43 +786,36 @@ bool Position::do_move(const Move move) {
 	}
 
 	// Hash out current en pas square
-	if (enPassant_ != SQ_NONE) posKey_ ^= Zobrist::enpassant[enPassant_ & 7];
+	if (st->enPassant != SQ_NONE) st->posKey ^= Zobrist::enpassant[st->enPassant & 7];
 	// Hash out current castling rights
-	posKey_ ^= Zobrist::castling[castlingRights_];
-
-	history_[hisPly_].move = move;
-	history_[hisPly_].fiftyMove = fiftyMove_;
-	history_[hisPly_].enPas = enPassant_;
-	history_[hisPly_].castlePerm = castlingRights_;
+	st->posKey ^= Zobrist::castling[st->castlingRights];
 
-	castlingRights_ &= CastlePerm[from];
-	castlingRights_ &= CastlePerm[to];
-	enPassant_ = SQ_NONE;
+	st->castlingRights &= CastlePerm[from];
+	st->castlingRights &= CastlePerm[to];
+	st->enPassant = SQ_NONE;
 
 	// Hash in the new castling rights
-	posKey_ ^= Zobrist::castling[castlingRights_];
+	st->posKey ^= Zobrist::castling[st->castlingRights];
 
-	++fiftyMove_;
+	++st->fiftyMove;
+	++st->pliesFromNull;
 
 	if (capt) {
 		clear_piece(to, enemySide);
-		fiftyMove_ = 0;
+		st->fiftyMove = 0;
 	}
 
-	++hisPly_;
-	++ply_;
-
 	if (pieces_[from] == PAWN) {
-		fiftyMove_ = 0;
-		if (move & FLAG_PS) {
+		st->fiftyMove = 0;
+		if ((int(to) ^ int(from)) == 16) {
 			if (side == WHITE) {
-				enPassant_ = from + NORTH;
+				st->enPassant = from + NORTH;
 			}
 			else {
-				enPassant_ = from + SOUTH;
+				st->enPassant = from + SOUTH;
 			}
 			// Hash in new en passant square
-			posKey_ ^= Zobrist::enpassant[enPassant_ & 7];
+			st->posKey ^= Zobrist::enpassant[st->enPassant & 7];
 		}
 	}
 
@@ -425,174 +831,189 @@ bool Position::do_move(const Move move) {
 	}
 
 	sideToMove_ = sideToMove_ == WHITE ? BLACK : WHITE;
-	posKey_ ^= Zobrist::side;
+	st->posKey ^= Zobrist::side;
 
-	if (attackers_to(kingSq_[side]) & OccupiedBB[enemySide][PIECETYPE_ANY]) {
-		undo_move();
-		return false;
-	}
-	return true;
+	set_check_info();
 }
 
+// Position::undo_move() takes back the last move. Keys, material, psq and the
+// check info of the previous position are still in its frame, so only the
+// board is restored here.
 void Position::undo_move() {
-	--hisPly_;
-	--ply_;
-
-	Move move = history_[hisPly_].move;
+	const StateInfo* st = state();
+	Move move = st->move;
 	Square from = from_sq(move);
 	Square to = to_sq(move);
-	PieceType capt = captured_piece(move);
-	PieceType prom = promoted_piece(move);
 
-	if (enPassant_ != SQ_NONE) posKey_ ^= Zobrist::enpassant[enPassant_ & 7];
-	posKey_ ^= Zobrist::castling[castlingRights_];
+	sideToMove_ = sideToMove_ == WHITE ? BLACK : WHITE;
 
-	castlingRights_ = history_[hisPly_].castlePerm;
-	fiftyMove_ = history_[hisPly_].fiftyMove;
-	enPassant_ = history_[hisPly_].enPas;
+	if (promoted_piece(move)) {
+		remove_piece(to, sideToMove_);
+		put_piece(to, PAWN, sideToMove_);
+	}
 
-	if (enPassant_ != SQ_NONE) posKey_ ^= Zobrist::enpassant[enPassant_ & 7];
-	posKey_ ^= Zobrist::castling[castlingRights_];
+	relocate_piece(to, from, sideToMove_);
 
-	sideToMove_ = sideToMove_ == WHITE ? BLACK : WHITE;
-	posKey_ ^= Zobrist::side;
+	if (pieces_[from] == KING)
+		kingSq_[sideToMove_] = from;
 
-	if (move & FLAG_EP) {
+	if (type_of(move) == ENPASSANT) {
 		if (sideToMove_ == WHITE) {
-			add_piece(to + SOUTH, PAWN, BLACK);
+			put_piece(to + SOUTH, PAWN, BLACK);
 		}
 		else {
-			add_piece(to + NORTH, PAWN, WHITE);
+			put_piece(to + NORTH, PAWN, WHITE);
 		}
 	}
-	else if (move & FLAG_CASTLE) {
+	else if (type_of(move) == CASTLING) {
 		switch (to) {
-		case SQ_C1: move_piece(SQ_D1, SQ_A1, WHITE); break;
-		case SQ_G1: move_piece(SQ_F1, SQ_H1, WHITE); break;
-		case SQ_C8: move_piece(SQ_D8, SQ_A8, BLACK); break;
-		case SQ_G8: move_piece(SQ_F8, SQ_H8, BLACK); break;
-		default: /*ERROR*/; break;
+		case SQ_C1: relocate_piece(SQ_D1, SQ_A1, WHITE); break;
+		case SQ_G1: relocate_piece(SQ_F1, SQ_H1, WHITE); break;
+		case SQ_C8: relocate_piece(SQ_D8, SQ_A8, BLACK); break;
+		case SQ_G8: relocate_piece(SQ_F8, SQ_H8, BLACK); break;
+		default: assert(false); break;
 		}
 	}
+	else if (st->capturedPiece)
+		put_piece(to, st->capturedPiece, ~sideToMove_);
 
-	move_piece(to, from, sideToMove_);
-
-	if (pieces_[from] == KING)
-		kingSq_[sideToMove_] = from;
-
-	if (capt)
-		add_piece(to, capt, ~sideToMove_);
-
-	if (prom) {
-		clear_piece(from, sideToMove_);
-		add_piece(from, PAWN, sideToMove_);
-	}
+	--st_;
+	--acc_;
+	--hisPly_;
+	--ply_;
 }
 
 void Position::do_null_move() {
+	StateInfo* st = state() + 1;
+	std::memcpy(st, state(), offsetof(StateInfo, move));
+
+	if (NNUE::Enabled)
+		acc_[1] = acc_[0];
+
+	st_ = st;
+	++acc_;
+	++hisPly_;
 	++ply_;
-	history_[hisPly_].posKey = posKey_;
 
-	if (enPassant_ != SQ_NONE) posKey_ ^= Zobrist::enpassant[enPassant_ & 7];
+	st->move = MOVE_NONE;
+	st->capturedPiece = PIECETYPE_NONE;
+	st->pliesFromNull = 0;
 
-	history_[hisPly_].move = MOVE_NONE;
-	history_[hisPly_].fiftyMove = fiftyMove_;
-	history_[hisPly_].enPas = enPassant_;
-	history_[hisPly_].castlePerm = castlingRights_;
-	enPassant_ = SQ_NONE;
+	if (st->enPassant != SQ_NONE) st->posKey ^= Zobrist::enpassant[st->enPassant & 7];
+	st->enPassant = SQ_NONE;
 
 	sideToMove_ = sideToMove_ == WHITE ? BLACK : WHITE;
-	++hisPly_;
-	posKey_ ^= Zobrist::side;
+	st->posKey ^= Zobrist::side;
+
+	set_check_info();
 }
 
 void Position::undo_null_move() {
+	sideToMove_ = sideToMove_ == WHITE ? BLACK : WHITE;
+
+	--st_;
+	--acc_;
 	--hisPly_;
 	--ply_;
-
-	if (enPassant_ != SQ_NONE) posKey_ ^= Zobrist::enpassant[enPassant_ & 7];
-
-	castlingRights_ = history_[hisPly_].castlePerm;
-	fiftyMove_ = history_[hisPly_].fiftyMove;
-	enPassant_ = history_[hisPly_].enPas;
-
-	if (enPassant_ != SQ_NONE) posKey_ ^= Zobrist::enpassant[enPassant_ & 7];
-	sideToMove_ = sideToMove_ == WHITE ? BLACK : WHITE;
-	posKey_ ^= Zobrist::side;
 }
 
 void Position::clear_piece(const Square s, const Color c) {
+	StateInfo* st = state();
 	PieceType pt = pieces_[s];
 
-	// Remove piece from posKey
-	posKey_ ^= Zobrist::psq[c][pt][s];
-	// Remove piece from piecelist
-	pieces_[s] = PIECETYPE_NONE;
+	remove_piece(s, c);
 
-	// Remove piece from bitboards
-	clear_bit(OccupiedBB[c][pt], s);
-	clear_bit(OccupiedBB[c][PIECETYPE_ANY], s);
-	clear_bit(OccupiedBB[BOTH][pt], s);
-	clear_bit(OccupiedBB[BOTH][PIECETYPE_ANY], s);
+	// Remove piece from keys
+	st->posKey ^= Zobrist::psq[c][pt][s];
+	if (pt == PAWN) st->pawnKey ^= Zobrist::psq[c][PAWN][s];
+	st->materialKey ^= Zobrist::psq[c][pt][popcount(occupiedBB_[c][pt])];
+
+	// Remove piece from the NNUE accumulator
+	if (NNUE::Enabled)
+		NNUE::remove_feature(*acc_, c, pt, s);
 
 	// Update psq
-	psq_[PHASE_MID] -= PSQT::psq[c][pt][s][PHASE_MID];
-	psq_[PHASE_END] -= PSQT::psq[c][pt][s][PHASE_END];
+	st->psq[PHASE_MID] -= PSQT::psq[c][pt][s][PHASE_MID];
+	st->psq[PHASE_END] -= PSQT::psq[c][pt][s][PHASE_END];
 
 	// Update nonpawn material
 	if (pt != KING && pt != PAWN)
-		nonPawnMaterial_[c] -= PSQT::PieceValue[PHASE_MID][pt];
+		st->nonPawnMaterial[c] -= PSQT::PieceValue[PHASE_MID][pt];
 }
 
 void Position::add_piece(const Square s, const PieceType pt, const Color c) {
-	// Add piece to posKey
-	posKey_ ^= Zobrist::psq[c][pt][s];
-	// Add piece to piecelist
-	pieces_[s] = pt;
+	StateInfo* st = state();
 
-	// Add piece to bitboards
-	set_bit(OccupiedBB[c][pt], s);
-	set_bit(OccupiedBB[c][PIECETYPE_ANY], s);
-	set_bit(OccupiedBB[BOTH][pt], s);
-	set_bit(OccupiedBB[BOTH][PIECETYPE_ANY], s);
+	put_piece(s, pt, c);
+
+	// Add piece to keys
+	st->posKey ^= Zobrist::psq[c][pt][s];
+	if (pt == PAWN) st->pawnKey ^= Zobrist::psq[c][PAWN][s];
+	st->materialKey ^= Zobrist::psq[c][pt][popcount(occupiedBB_[c][pt]) - 1];
+
+	// Add piece to the NNUE accumulator
+	if (NNUE::Enabled)
+		NNUE::add_feature(*acc_, c, pt, s);
 
 	// Update psq
-	psq_[PHASE_MID] += PSQT::psq[c][pt][s][PHASE_MID];
-	psq_[PHASE_END] += PSQT::psq[c][pt][s][PHASE_END];
+	st->psq[PHASE_MID] += PSQT::psq[c][pt][s][PHASE_MID];
+	st->psq[PHASE_END] += PSQT::psq[c][pt][s][PHASE_END];
 
 	// Update nonpawn material
 	if (pt != KING && pt != PAWN)
-		nonPawnMaterial_[c] += PSQT::PieceValue[PHASE_MID][pt];
+		st->nonPawnMaterial[c] += PSQT::PieceValue[PHASE_MID][pt];
 }
 
 void Position::move_piece(const Square from, const Square to, const Color c) {
+	StateInfo* st = state();
 	PieceType pt = pieces_[from];
 
-	// Remove piece from posKey
-	posKey_ ^= Zobrist::psq[c][pt][from];
-	// Remove piece from piecelist
-	pieces_[from] = PIECETYPE_NONE;
-
-	// Add piece to posKey
-	posKey_ ^= Zobrist::psq[c][pt][to];
-	// Add piece to piecelist
-	pieces_[to] = pt;
+	relocate_piece(from, to, c);
 
-	// Remove piece from bitboards
-	clear_bit(OccupiedBB[c][pt], from);
-	clear_bit(OccupiedBB[c][PIECETYPE_ANY], from);
-	clear_bit(OccupiedBB[BOTH][pt], from);
-	clear_bit(OccupiedBB[BOTH][PIECETYPE_ANY], from);
+	// Move piece in keys
+	st->posKey ^= Zobrist::psq[c][pt][from] ^ Zobrist::psq[c][pt][to];
+	if (pt == PAWN) st->pawnKey ^= Zobrist::psq[c][PAWN][from] ^ Zobrist::psq[c][PAWN][to];
 
-	// Add piece to bitboards
-	set_bit(OccupiedBB[c][pt], to);
-	set_bit(OccupiedBB[c][PIECETYPE_ANY], to);
-	set_bit(OccupiedBB[BOTH][pt], to);
-	set_bit(OccupiedBB[BOTH][PIECETYPE_ANY], to);
+	// Move piece in the NNUE accumulator
+	if (NNUE::Enabled)
+		NNUE::move_feature(*acc_, c, pt, from, to);
 
 	// Update psq
-	psq_[PHASE_MID] -= PSQT::psq[c][pt][from][PHASE_MID];
-	psq_[PHASE_END] -= PSQT::psq[c][pt][from][PHASE_END];
-	psq_[PHASE_MID] += PSQT::psq[c][pt][to][PHASE_MID];
-	psq_[PHASE_END] += PSQT::psq[c][pt][to][PHASE_END];
+	st->psq[PHASE_MID] -= PSQT::psq[c][pt][from][PHASE_MID];
+	st->psq[PHASE_END] -= PSQT::psq[c][pt][from][PHASE_END];
+	st->psq[PHASE_MID] += PSQT::psq[c][pt][to][PHASE_MID];
+	st->psq[PHASE_END] += PSQT::psq[c][pt][to][PHASE_END];
+}
+
+void Position::put_piece(const Square s, const PieceType pt, const Color c) {
+	pieces_[s] = pt;
+
+	set_bit(occupiedBB_[c][pt], s);
+	set_bit(occupiedBB_[c][PIECETYPE_ANY], s);
+	set_bit(occupiedBB_[BOTH][pt], s);
+	set_bit(occupiedBB_[BOTH][PIECETYPE_ANY], s);
+}
+
+void Position::remove_piece(const Square s, const Color c) {
+	PieceType pt = pieces_[s];
+
+	pieces_[s] = PIECETYPE_NONE;
+
+	clear_bit(occupiedBB_[c][pt], s);
+	clear_bit(occupiedBB_[c][PIECETYPE_ANY], s);
+	clear_bit(occupiedBB_[BOTH][pt], s);
+	clear_bit(occupiedBB_[BOTH][PIECETYPE_ANY], s);
+}
+
+void Position::relocate_piece(const Square from, const Square to, const Color c) {
+	PieceType pt = pieces_[from];
+	Bitboard fromTo = SquareBB[from] | SquareBB[to];
+
+	pieces_[from] = PIECETYPE_NONE;
+	pieces_[to] = pt;
+
+	occupiedBB_[c][pt] ^= fromTo;
+	occupiedBB_[c][PIECETYPE_ANY] ^= fromTo;
+	occupiedBB_[BOTH][pt] ^= fromTo;
+	occupiedBB_[BOTH][PIECETYPE_ANY] ^= fromTo;
 }
\ No newline at end of file
@@ -2,29 +2,45 @@
 
 #include <string>
 
-#include "position.h"
 #include "bitboard.h"
+#include "nnue.h"
 #include "utils/defs.h"
 
+class SearchContext;
+
 namespace Zobrist {
-	void init_keys();
+	extern const Key side;
+
+	// material_key() returns the material key of the given piece counts, the
+	// same as a position with these pieces has.
+	Key material_key(const int counts[COLOR_NB][PIECETYPE_NB]);
 }
 
+// Position is the board of one search thread. It holds the pieces and
+// pointers to the current frames of the state and accumulator stacks, which
+// live in the thread's SearchContext together with all search-only data, so
+// that a position fits in a few cache lines and is cheap to copy.
 class Position {
 public:
-	Position();
+	explicit Position(SearchContext& ctx);
+	Position(const Position& pos, SearchContext& ctx);
 
 	void set(std::string fen);
-	const std::string fen() const;
+
+	// Makes room on the stacks for a game of the given length and a search
+	void reserve(int gamePlies);
 
 	void print() const;
 
-	bool do_move(const Move move);
+	void do_move(const Move move);
 	void undo_move();
 	void do_null_move();
 	void undo_null_move();
 
 	Key pos_key() const;
+	Key pawn_key() const;
+	Key material_key() const;
+	Key key_after(const Move m) const;
 	Value psq_score(Phase p) const;
 	Color side_to_move() const;
 	CastlingRight castling_rights() const;
@@ -33,7 +49,12 @@ public:
 	Square en_passant() const;
 	Square king_sq() const;
 	Square king_sq(Color side) const;
+	Bitboard checkers() const;
+	Bitboard pinned() const;
 	PieceType piece_on_sq(int sq) const;
+	PieceType moved_piece(Move m) const;
+	PieceType captured_piece(Move m) const;
+	bool capture_or_promotion(Move m) const;
 	Value non_pawn_material(Color c) const;
 	Value non_pawn_material() const;
 
@@ -43,27 +64,29 @@ public:
 	Bitboard pieces(Color c, PieceType pt) const;
 
 	bool advanced_pawn_push(Move m) const;
+	bool pseudo_legal(const Move m) const;
+	bool legal(const Move m) const;
+
+	// Static exchange evaluation
+	bool see(const Move m, Value threshold) const;
 
 	int ply() const;
 	void ply_reset();
 	int his_ply() const;
-	void his_ply_reset();
 
-	bool is_repetition();
+	// Repetitions, of an earlier position and upcoming ones
+	bool is_repetition() const;
+	bool has_game_cycle() const;
+
+	// Search thread data, the context this position is played in
+	SearchContext& context() const;
+
+	// NNUE accumulator of the current ply
+	const NNUE::Accumulator& accumulator() const;
+	void refresh_accumulator();
 
 	// Principal variation
-	Move best_move() const;
-	void best_move_set(Move m);
-	void print_pv();
-
-	// Move ordering, non captures
-	Order history_move(Move move) const;
-	void history_move_set(Move move, Order incr);
-	void history_moves_reset();
-	Move killer_move1() const;
-	Move killer_move2() const;
-	void killer_move_set(const Move m);
-	void killer_moves_reset();
+	void print_pv() const;
 
 	// Attacks to/from a given square
 	Bitboard attackers_to(Square s) const;
@@ -75,14 +98,21 @@ public:
 private:
 	Piece piece_at_square(Square sq) const;
 	void calculate_pos_key();
-	
-	bool is_real_move(Move move);
+	void set_check_info();
+
+	StateInfo* state();
+	const StateInfo* state() const;
 
-	// do_move, undo_move
+	// do_move, updating the board and the current state
 	void clear_piece(const Square s, const Color c);
 	void add_piece(const Square s, const PieceType pt, const Color c);
 	void move_piece(const Square from, const Square to, const Color c);
 
+	// undo_move, updating the board only
+	void put_piece(const Square s, const PieceType pt, const Color c);
+	void remove_piece(const Square s, const Color c);
+	void relocate_piece(const Square from, const Square to, const Color c);
+
 	// fen
 	void add_piece(Piece pc, Square s);
 	void add_pawn(Color c, Square s);
@@ -93,47 +123,46 @@ private:
 	void add_king(Color c, Square s);
 	void clear_pieces();
 
-	std::string fen_;
+	Bitboard occupiedBB_[3][7]; // [color][piecetype]
+	PieceType pieces_[SQUARE_NB];
+	Square kingSq_[BOTH];
 	Color sideToMove_ = WHITE;
-	Key posKey_ = 0;
-
-	Square enPassant_ = SQ_NONE;
-	CastlingRight castlingRights_ = NO_CASTLING;
-	int fiftyMove_ = 0;
 	int ply_ = 0;
 	int hisPly_ = 0;
-	Move bestMoveRoot_;
 
-	Undo history_[MAX_GAMELENGTH];
-	Square kingSq_[BOTH];
-	PieceType pieces_[SQUARE_NB];
-	Move pvArray_[DEPTH_MAX];
-	Value psq_[PHASE_NB];
-	Value nonPawnMaterial_[COLOR_NB];
-
-	// Move ordering, non captures
-	Order historyMoves_[COLOR_NB][SQUARE_NB][SQUARE_NB]; // [color][sq][sq]
-	Move killerMoves_[2][DEPTH_MAX]; // [killercount == 2][ply]
+	// Current frames of the context's state and accumulator stacks, both are
+	// indexed by hisPly_ from the start of the game.
+	SearchContext* ctx_;
+	StateInfo* st_;
+	NNUE::Accumulator* acc_;
 };
 
 inline Color Position::side_to_move() const {
 	return sideToMove_;
 }
 
+inline StateInfo* Position::state() {
+	return st_;
+}
+
+inline const StateInfo* Position::state() const {
+	return st_;
+}
+
 inline CastlingRight Position::castling_rights() const {
-	return castlingRights_;
+	return state()->castlingRights;
 }
 
 inline bool Position::can_castle(CastlingRight cr) const {
-	return castlingRights_ & cr;
+	return state()->castlingRights & cr;
 }
 
 inline int Position::fifty_move() const {
-	return fiftyMove_;
+	return state()->fiftyMove;
 }
 
 inline Square Position::en_passant() const {
-	return enPassant_;
+	return state()->enPassant;
 }
 
 inline Square Position::king_sq(Color side) const {
@@ -144,32 +173,54 @@ inline Square Position::king_sq() const {
 	return kingSq_[sideToMove_];
 }
 
+inline Bitboard Position::checkers() const {
+	return state()->checkers;
+}
+
+inline Bitboard Position::pinned() const {
+	return state()->pinned;
+}
+
 inline PieceType Position::piece_on_sq(int sq) const {
 	return pieces_[sq];
 }
 
+inline PieceType Position::moved_piece(Move m) const {
+	return pieces_[from_sq(m)];
+}
+
+// captured_piece() returns the piece on the destination square of a move, so
+// it is PIECETYPE_NONE for en passant.
+inline PieceType Position::captured_piece(Move m) const {
+	return pieces_[to_sq(m)];
+}
+
+inline bool Position::capture_or_promotion(Move m) const {
+	return type_of(m) != NORMAL ? type_of(m) != CASTLING : pieces_[to_sq(m)] != PIECETYPE_NONE;
+}
+
 inline Value Position::non_pawn_material(Color c) const {
-	return nonPawnMaterial_[c];
+	return state()->nonPawnMaterial[c];
 }
 
 inline Value Position::non_pawn_material() const {
-	return nonPawnMaterial_[WHITE] + nonPawnMaterial_[BLACK];
+	return state()->nonPawnMaterial[WHITE] + state()->nonPawnMaterial[BLACK];
 }
 
 inline Bitboard Position::pieces() const {
-	return OccupiedBB[BOTH][PIECETYPE_ANY];
+	return occupiedBB_[BOTH][PIECETYPE_ANY];
 }
 
 inline Bitboard Position::pieces(PieceType pt) const {
-	return OccupiedBB[BOTH][pt];
+	return occupiedBB_[BOTH][pt];
 }
 
 inline Bitboard Position::pieces(Color c) const {
-	return OccupiedBB[c][PIECETYPE_ANY];
+	return occupiedBB_[c][PIECETYPE_ANY];
 }
 
 inline Bitboard Position::pieces(Color c, PieceType pt) const {
-	return OccupiedBB[c][pt];
+	return occupiedBB_[c][pt];
 }
 
 inline int Position::ply() const {
@@ -184,51 +235,28 @@ inline int Position::his_ply() const {
 	return hisPly_;
 }
 
-inline void Position::his_ply_reset() {
-	hisPly_ = 0;
-}
-
 inline Key Position::pos_key() const {
-	return posKey_;
+	return state()->posKey;
 }
 
-inline Value Position::psq_score(Phase p) const {
-	return psq_[p];
+inline Key Position::pawn_key() const {
+	return state()->pawnKey;
 }
 
-inline Order Position::history_move(Move move) const {
-	return historyMoves_[sideToMove_][from_sq(move)][to_sq(move)];
+inline Key Position::material_key() const {
+	return state()->materialKey;
 }
 
-inline void Position::history_move_set(Move move, Order incr) {
-	historyMoves_[sideToMove_][from_sq(move)][to_sq(move)] += incr;
+inline SearchContext& Position::context() const {
+	return *ctx_;
 }
 
-inline void Position::history_moves_reset() {
-	for (Color c = WHITE; c <= BLACK; ++c)
-		for (Square from = SQ_A1; from <= SQ_H8; ++from)
-			for (Square to = SQ_A1; to <= SQ_H8; ++to)
-				historyMoves_[c][from][to] = ORDER_ZERO;
+inline const NNUE::Accumulator& Position::accumulator() const {
+	return *acc_;
 }
 
-inline Move Position::killer_move1() const {
-	return killerMoves_[0][ply_];
-}
-
-inline Move Position::killer_move2() const {
-	return killerMoves_[1][ply_];
-}
-
-inline void Position::killer_move_set(const Move m) {
-	killerMoves_[1][ply_] = killerMoves_[0][ply_];
-	killerMoves_[0][ply_] = m;
-}
-
-inline void Position::killer_moves_reset() {
-	for (int ply = 0; ply < DEPTH_MAX; ++ply) {
-		killerMoves_[0][ply] = MOVE_NONE;
-		killerMoves_[1][ply] = MOVE_NONE;
-	}
+inline Value Position::psq_score(Phase p) const {
+	return state()->psq[p];
 }
 
 inline bool Position::advanced_pawn_push(Move m) const {
@@ -239,7 +267,7 @@ inline bool Position::advanced_pawn_push(Move m) const {
 template<PieceType Pt>
 inline Bitboard Position::attacks_from(Square s) const {
 	assert(Pt != PAWN);
-	return  Pt == BISHOP || Pt == ROOK ? attacks_bb<Pt>(s, OccupiedBB[BOTH][PIECETYPE_ANY])
+	return  Pt == BISHOP || Pt == ROOK ? attacks_bb<Pt>(s, occupiedBB_[BOTH][PIECETYPE_ANY])
 		: Pt == QUEEN ? attacks_from<ROOK>(s) | attacks_from<BISHOP>(s)
 		: Pt == KNIGHT ? KnightAttacks[s]
 		: KingAttacks[s];
@@ -252,9 +280,9 @@ inline Bitboard Position::attacks_from<PAWN>(Square s, Color c) const {
 
 inline Bitboard Position::attacks_from(PieceType pt, Square s) const {
 	assert(pt != PAWN);
-	return attacks_bb(pt, s, OccupiedBB[BOTH][PIECETYPE_ANY]);
+	return attacks_bb(pt, s, occupiedBB_[BOTH][PIECETYPE_ANY]);
 }
 
 inline Bitboard Position::attackers_to(Square s) const {
-	return attackers_to(s, OccupiedBB[BOTH][PIECETYPE_ANY]);
+	return attackers_to(s, occupiedBB_[BOTH][PIECETYPE_ANY]);
 }
\ No newline at end of file
@@ -1,5 +1,3 @@
-#include <algorithm>
-
 #include "psqt.h"
 
 namespace PSQT {
@@ -74,26 +72,30 @@ namespace PSQT {
 		{ { Value(-10), Value(-1) },{ Value(6), Value(-6) },{ Value(-5), Value(18) },{ Value(-11), Value(22) },{ Value(-2), Value(22) },{ Value(-14), Value(17) },{ Value(12), Value(2) },{ Value(-1), Value(9) } }
 	};
 
-	Value psq[COLOR_NB][PIECETYPE_NB][SQUARE_NB][PHASE_NB];
+	// make_psq() computes the piece-square tables: the white halves of the
+	// tables are copied from Bonus[] adding the piece value, then the black
+	// halves of the tables are initialized by flipping and changing the sign of
+	// the white scores.
+	constexpr Table make_psq() {
+		Table t = {};
 
-	// init() initializes piece-square tables: the white halves of the tables are
-	// copied from Bonus[] adding the piece value, then the black halves of the
-	// tables are initialized by flipping and changing the sign of the white scores.
-	void init() {
 		for (PieceType pt = PIECETYPE_NONE; pt <= KING; ++pt) {
 			for (Square s = SQ_A1; s <= SQ_H8; ++s) {
-				File f = std::min(file_of(s), ~file_of(s));
+				File f = file_of(s) < ~file_of(s) ? file_of(s) : ~file_of(s);
 
-				psq[WHITE][pt][s][PHASE_MID] = PieceValue[PHASE_MID][pt] + (pt == PAWN ? PBonus[rank_of(s)][file_of(s)][PHASE_MID]
+				t[WHITE][pt][s][PHASE_MID] = PieceValue[PHASE_MID][pt] + (pt == PAWN ? PBonus[rank_of(s)][file_of(s)][PHASE_MID]
 					: Bonus[pt][rank_of(s)][f][PHASE_MID]);
 
-				psq[WHITE][pt][s][PHASE_END] = PieceValue[PHASE_END][pt] + (pt == PAWN ? PBonus[rank_of(s)][file_of(s)][PHASE_END]
+				t[WHITE][pt][s][PHASE_END] = PieceValue[PHASE_END][pt] + (pt == PAWN ? PBonus[rank_of(s)][file_of(s)][PHASE_END]
 					: Bonus[pt][rank_of(s)][f][PHASE_END]);
 
-				psq[BLACK][pt][~s][PHASE_MID] = -psq[WHITE][pt][s][PHASE_MID];
-				psq[BLACK][pt][~s][PHASE_END] = -psq[WHITE][pt][s][PHASE_END];
+				t[BLACK][pt][~s][PHASE_MID] = -t[WHITE][pt][s][PHASE_MID];
+				t[BLACK][pt][~s][PHASE_END] = -t[WHITE][pt][s][PHASE_END];
 			}
 		}
+
+		return t;
 	}
 
-}
+	constexpr Table psq = make_psq();
+}
\ No newline at end of file
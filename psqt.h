@@ -8,7 +8,7 @@ namespace PSQT {
 		{ VALUE_ZERO, PawnValueEg, KnightValueEg, BishopValueEg, RookValueEg, QueenValueEg }
 	};
 	
-	extern Value psq[COLOR_NB][PIECETYPE_NB][SQUARE_NB][PHASE_NB];
+	typedef Array<Array<Array<Array<Value, PHASE_NB>, SQUARE_NB>, PIECETYPE_NB>, COLOR_NB> Table;
 
-	void init();
+	extern const Table psq; // [color][piecetype][square][phase]
 }
\ No newline at end of file
@@ -1,11 +1,19 @@
 ﻿#include <algorithm>
 #include <iostream>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "search.h"
 #include "evaluate.h"
 #include "bitboard.h"
 #include "movegen.h"
+#include "movepick.h"
+#include "searchcontext.h"
 #include "timeman.h"
 #include "uci.h"
 #include "tt.h"
@@ -13,32 +21,29 @@
 
 namespace Search {
 
-	bool StopSignal = false;
+	// update_capture_history() rewards the capture causing a beta cutoff, and
+	// punishes the captures which were searched before it.
+	static void update_capture_history(Position& pos, Move bestMove, Move* captures, int captureCount, Depth depth) {
+		SearchContext& ctx = pos.context();
+		int bonus = std::min(int(depth) * int(depth), CaptureHistoryMax);
 
-	static void pick_move(int moveNum, Movelist& list) {
-		MoveEntry temp;
-		Order bestScore = ORDER_ZERO;
-		int bestNum = moveNum;
+		if (pos.captured_piece(bestMove))
+			ctx.capture_history_update(pos, bestMove, bonus);
 
-		for (int index = moveNum; index < list.count; ++index) {
-			if (list.moves[index].order > bestScore) {
-				bestScore = list.moves[index].order;
-				bestNum = index;
-			}
-		}
-		temp = list.moves[moveNum];
-		list.moves[moveNum] = list.moves[bestNum];
-		list.moves[bestNum] = temp;
+		for (int i = 0; i < captureCount; ++i)
+			ctx.capture_history_update(pos, captures[i], -bonus);
 	}
 
 	static void clear_for_search(Position& pos, SearchInfo& info) {
-		pos.history_moves_reset();
-		pos.killer_moves_reset();
+		pos.context().clear();
 		pos.ply_reset();
+		pos.refresh_accumulator();
 
 		info.startTime = Timeman::get_time();
-		info.stopped = 0;
+		info.stopped = false;
 		info.nodes = 0;
+		info.completedDepth = DEPTH_ZERO;
+		info.bestValue = -VALUE_INFINITE;
 		info.fh = 0;
 		info.fhf = 0;
 	}
@@ -46,46 +51,63 @@ namespace Search {
 	template <NodeType NT>
 	static Value qsearch(Value alpha, Value beta, Position& pos, SearchInfo& info) {
 		Timeman::check_time_up(info);
-		info.nodes++;
+		++info.nodes;
 
 		if (pos.is_repetition() || pos.fifty_move() >= 100) return VALUE_DRAW;
 		if (pos.ply() > DEPTH_MAX - 1) return Evaluation::evaluate(pos);
 
-		bool found;
+		// If we can repeat an earlier position, we can at least draw
+		if (alpha < VALUE_DRAW && pos.has_game_cycle()) {
+			alpha = VALUE_DRAW;
+			if (alpha >= beta)
+				return alpha;
+		}
+
+		bool found, inCheck = pos.checkers();
+		Move move;
 		
 		// Check for position in TT
 		TTEntry* ttEntry = TT.probe(pos.pos_key(), found);
 		if (found) {
-			if (ttEntry->bound == BOUND_EXACT) {
-				return ttEntry->value;
+			if (ttEntry->bound() == BOUND_EXACT) {
+				return ttEntry->value();
 			}
-			else if (ttEntry->bound == BOUND_LOWER)
-				alpha = std::max(alpha, ttEntry->value);
-			else if (ttEntry->bound == BOUND_UPPER)
-				beta = std::min(beta, ttEntry->value);
+			else if (ttEntry->bound() == BOUND_LOWER)
+				alpha = std::max(alpha, ttEntry->value());
+			else if (ttEntry->bound() == BOUND_UPPER)
+				beta = std::min(beta, ttEntry->value());
 
-			if (alpha >= beta) return ttEntry->value;
+			if (alpha >= beta) return ttEntry->value();
 		}
 
-		Value score = Evaluation::evaluate(pos);
+		Value score;
 
-		// Stand pat. Return immediately if static value is at least beta
-		if (score >= beta)
-			return beta;
+		// Stand pat. Return immediately if static value is at least beta.
+		// When in check all evasions are searched instead.
+		if (!inCheck) {
+			score = Evaluation::evaluate(pos);
 
-		if (score > alpha)
-			alpha = score;
+			if (score >= beta)
+				return beta;
 
-		Movelist list = Movelist();
-		Movegen::get_moves_noisy(pos, list);
+			if (score > alpha)
+				alpha = score;
+		}
+
+		MovePicker mp(pos, found ? ttEntry->move() : MOVE_NONE, DEPTH_ZERO);
 
 		int legal = 0;
 		Value oldAlpha = alpha;
 	    score = -VALUE_INFINITE;
 
-		for (int moveNum = 0; moveNum < list.count; ++moveNum) {
-			pick_move(moveNum, list);
-			if (!pos.do_move(list.moves[moveNum].move)) continue;
+		while ((move = mp.next_move()) != MOVE_NONE) {
+
+			// Don't search captures which lose material, unless we are in check
+			if (!inCheck && !pos.see(move, VALUE_ZERO))
+				continue;
+
+			TT.prefetch(pos.key_after(move));
+			pos.do_move(move);
 
 			legal++;
 			score = -qsearch<NT>(-beta, -alpha, pos, info);
@@ -103,6 +125,10 @@ namespace Search {
 			}
 		}
 
+		// No evasions, checkmate
+		if (inCheck && legal == 0)
+			return mated_in(pos.ply());
+
 		return alpha;
 	}
 
@@ -113,12 +139,18 @@ namespace Search {
 		
 		Color us = pos.side_to_move();
 		TTEntry* ttEntry;
-		Value eval, ttValue = VALUE_NONE, bestValue = -VALUE_INFINITE, childValue, alphaOrig = alpha;
+		Value eval, staticEval, ttValue = VALUE_NONE, bestValue = -VALUE_INFINITE, childValue, alphaOrig = alpha;
 		Value futilityMargin, seeMargin[2];
 		Move ttMove = MOVE_NONE, bestMove = MOVE_NONE, move = MOVE_NONE;
 		Depth R;
+		Move capturesSearched[32];
 		bool ttHit, inCheck, isQuiet, doFullSearch;
-		int legalCount = 0;
+		int legalCount = 0, moveNum = 0, captureCount = 0;
+
+		// A PV node starts with an empty line, so that its parent never copies
+		// a line left over from another node.
+		if (pvNode)
+			pos.context().pv_clear(pos.ply());
 
 		// Step 1. Quiescence Search.
 		if (depth <= DEPTH_ZERO) 
@@ -128,7 +160,7 @@ namespace Search {
 		assert(pvNode || (alpha == beta - 1));
 		assert(DEPTH_ZERO < depth && depth < DEPTH_MAX);
 		assert(depth / ONE_PLY * ONE_PLY == depth);
-		info.nodes++;
+		++info.nodes;
 
 		// Step 2. Time up check.
 		Timeman::check_time_up(info);
@@ -142,6 +174,14 @@ namespace Search {
 			if (pos.ply() >= DEPTH_MAX)
 				return Evaluation::evaluate(pos);
 
+			// Upcoming repetition. If we have a move back to an earlier
+			// position, we can at least draw.
+			if (alpha < VALUE_DRAW && pos.has_game_cycle()) {
+				alpha = VALUE_DRAW;
+				if (alpha >= beta)
+					return alpha;
+			}
+
 			// Mate distance pruning. Even if we mate at the next move our
 			// alpha is already bigger because a shorter mate was found.
 			alpha = std::max(mated_in(pos.ply()), alpha);
@@ -152,32 +192,37 @@ namespace Search {
 
 		// Step 4. Check for position in the transposition table.
 		ttEntry = TT.probe(pos.pos_key(), ttHit);
-		if (ttHit && ttEntry->depth >= depth) 
+		ttMove = ttHit ? ttEntry->move() : MOVE_NONE;
+
+		if (ttHit && ttEntry->depth() >= depth) 
 		{
-			ttMove = ttEntry->move;
-			ttValue = ttEntry->value;
-			
-			if (rootNode)
-				info.bestMove = ttMove;
+			ttValue = ttEntry->value();
 
-			if (ttEntry->bound == BOUND_EXACT) 
+			// An exact entry only ends the search of a non PV node. A PV node is
+			// searched on, so that its line in the PV table is complete.
+			if (!pvNode && ttEntry->bound() == BOUND_EXACT)
+				return ttValue;
+
+			// A bound cuts, but does not narrow the window. A PV node searched
+			// on a narrowed window could return a value without a line, and
+			// with a null window narrowing makes no difference. The root is
+			// always searched, so that the iteration has a best move.
+			if (   !rootNode
+				&& (   (ttEntry->bound() == BOUND_LOWER && ttValue >= beta)
+					|| (ttEntry->bound() == BOUND_UPPER && ttValue <= alpha)))
 				return ttValue;
-			else if (ttEntry->bound == BOUND_LOWER)
-				alpha = std::max(alpha, ttValue);
-			else if (ttEntry->bound == BOUND_UPPER)
-				beta = std::min(beta, ttValue);
-		
-			if (alpha >= beta) return ttValue;
 		}
 
 		// Step 5. Initialize some flags and values.
 		
 		// Calculate whether we are in check
-		inCheck = pos.attackers_to(pos.king_sq()) & pos.pieces(~us);
+		inCheck = pos.checkers();
 		
-		// Calculate static evalation, reuse TT entry value if possible
-		eval = ttHit && ttValue != VALUE_NONE ? ttValue
-											  : Evaluation::evaluate(pos);
+		// Calculate static evalation, reuse the TT entry's static eval if possible,
+		// and use the TT entry value as a better estimate when available.
+		staticEval = ttHit && ttEntry->eval() != VALUE_NONE ? ttEntry->eval()
+															: Evaluation::evaluate(pos);
+		eval = ttValue != VALUE_NONE ? ttValue : staticEval;
 
 		// Futility Pruning Margin
 		futilityMargin = eval + FutilityMargin * depth;
@@ -232,29 +277,22 @@ namespace Search {
 
 		if (inCheck) ++depth;
 
-		Movelist list = Movelist();
-		Movegen::get_moves(pos, list);
-		
-		if (ttMove != MOVE_NONE) {
-			for (int moveNum = 0; moveNum < list.count; ++moveNum) {
-				if (list.moves[moveNum].move == ttMove) {
-					list.moves[moveNum].order = ORDER_TT;
-					break;
-				}
-			}
-		}
+		// At the root the best move of the last iteration is tried first, even
+		// when its TT entry has been overwritten.
+		if (rootNode && pos.context().pv_length())
+			ttMove = pos.context().pv()[0];
 
-		for (int moveNum = 0; moveNum < list.count; ++moveNum) {
-			doFullSearch = true;
+		MovePicker mp(pos, ttMove);
 
-			pick_move(moveNum, list);
-			move = list.moves[moveNum].move;
+		while ((move = mp.next_move()) != MOVE_NONE) {
+			doFullSearch = true;
+			++moveNum;
 
-			if (!pos.do_move(move)) 
-				continue;
+			isQuiet = !pos.capture_or_promotion(move);
 
+			TT.prefetch(pos.key_after(move));
+			pos.do_move(move);
 			legalCount++;
-			isQuiet = !(move & FLAG_NOISY);
 
 			// Futility pruning: frontier
 			if (    depth == 1
@@ -274,7 +312,7 @@ namespace Search {
 				&& isQuiet
 				&& !inCheck) 
 			{
-				Depth reducedDepth = moveNum <= 6 ? 2 * ONE_PLY : depth / 3 + ONE_PLY;
+				Depth reducedDepth = moveNum <= 7 ? 2 * ONE_PLY : depth / 3 + ONE_PLY;
 				childValue = -search<NonPV>(-alpha-1, -alpha, depth - reducedDepth, pos, info, true);
 				if (childValue <= alpha) doFullSearch = false;
 			}
@@ -296,17 +334,25 @@ namespace Search {
 				if (bestValue > alpha) {
 					alpha = bestValue;
 
+					if (pvNode)
+						pos.context().pv_update(pos.ply(), move);
+
 					// Too good, beta cut-off
 					if (alpha >= beta) {
 						if (isQuiet)
-							pos.killer_move_set(bestMove);
+							pos.context().killer_move_set(pos.ply(), bestMove);
+
+						update_capture_history(pos, bestMove, capturesSearched, captureCount, depth);
 						break;
 					}
 
 					if (isQuiet)
-						pos.history_move_set(bestMove, (Order)depth);
+						pos.context().history_move_set(us, bestMove, (Order)depth);
 				}
 			}
+
+			if (pos.captured_piece(move) && captureCount < 32)
+				capturesSearched[captureCount++] = move;
 		}
 
 		// Save bestmove if inside root node
@@ -321,7 +367,7 @@ namespace Search {
 					 : bestValue > alphaOrig ? BOUND_EXACT 
 				     : BOUND_UPPER;
 
-		TT.save(pos.pos_key(), bestMove, bestValue, bound, depth);
+		ttEntry->save(pos.pos_key(), bestValue, bound, depth, bestMove, staticEval);
 
 		return bestValue;
 	}
@@ -359,16 +405,67 @@ namespace Search {
 		return VALUE_NONE;
 	}
 	
-	void start(Position& pos, SearchInfo& info) {
+	// Helper threads skip some depths, so that the threads of a Lazy SMP search
+	// spread over different iterations instead of all searching the same one.
+	constexpr int SkipSize[]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+	constexpr int SkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
+	// A helper thread of Lazy SMP. Helpers are created with the Threads option
+	// and sleep between searches. Each one searches its own copy of the board
+	// in its own context, which keeps its history tables and evaluation caches
+	// from one search to the next, and shares only the transposition table.
+	class Helper {
+	public:
+		explicit Helper(int id);
+		~Helper();
+
+		// Copies the root position and limits of the main thread, and wakes
+		// the helper up to search them
+		void start(const Position& root, SearchInfo& mainInfo);
+
+		// Waits until the search of the helper has stopped
+		void wait();
+
+		SearchContext ctx;
+		Position pos;
+		SearchInfo info = SearchInfo();
+
+	private:
+		void idle_loop();
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		bool searching = false;
+		bool exit = false;
+		std::thread thread;
+	};
+
+	static std::vector<std::unique_ptr<Helper>> Helpers;
+
+	// nodes_searched() sums the nodes of the main thread and of the helpers
+	// searching along with it
+	static uint64_t nodes_searched(const SearchInfo& info) {
+		uint64_t nodes = info.nodes;
+
+		for (int i = 0; i < Threads - 1; ++i)
+			nodes += Helpers[i]->info.nodes;
+
+		return nodes;
+	}
+
+	static void iterative_deepening(Position& pos, SearchInfo& info) {
 		Value eval = VALUE_ZERO;
 		Depth depth = ONE_PLY;
 
-		// Prepare for search
-		clear_for_search(pos, info);
+		for ( ; depth <= info.depth; ++depth) {
+
+			// Helper threads skip depths based on their thread id
+			if (info.threadId) {
+				int i = (info.threadId - 1) % 20;
+				if (((depth + SkipPhase[i]) / SkipSize[i]) % 2)
+					continue;
+			}
 
-		// Iterative deepening
-		while (depth <= info.depth) {
-	
 			// Begin searching.
 			eval = aspiration_window(pos, info, depth, eval);
 
@@ -376,18 +473,182 @@ namespace Search {
 			if (info.stopped) break;
 
 			// Save best move
-			pos.best_move_set(info.bestMove);
+			pos.context().best_move_set(info.bestMove);
+			pos.context().pv_save();
+			info.completedDepth = depth;
+			info.bestValue = eval;
+
+			// Report results, only the main thread talks to the interface.
+			if (!info.threadId)
+				UCI::report(pos, info, depth, eval, nodes_searched(info));
+		}
+	}
+
+	Helper::Helper(int id)
+		: pos(ctx) {
+
+		info.threadId = id;
+		thread = std::thread(&Helper::idle_loop, this);
+	}
+
+	Helper::~Helper() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			exit = true;
+		}
+
+		cv.notify_all();
+		thread.join();
+	}
+
+	void Helper::start(const Position& root, SearchInfo& mainInfo) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			int id = info.threadId;
+
+			pos = Position(root, ctx);
+			ctx.new_search();
+			info = mainInfo;
+			info.threadId = id;
+			info.mainInfo = &mainInfo;
+			searching = true;
+		}
+
+		cv.notify_all();
+	}
+
+	void Helper::wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [&] { return !searching; });
+	}
+
+	void Helper::idle_loop() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while (true) {
+			cv.wait(lock, [&] { return searching || exit; });
+
+			if (exit)
+				return;
+
+			lock.unlock();
+			iterative_deepening(pos, info);
+			lock.lock();
+
+			searching = false;
+			cv.notify_all();
+		}
+	}
 
-			// Report results.
-			UCI::report(pos, info, depth, eval);
+	int Threads = 1;
+	int CheckpointInterval = 0;
+	std::string HashFile;
 
-			// Next depth
-			++depth;
+	// Saves the transposition table periodically until the search stops, so a
+	// long analysis can resume from a warm table after a restart.
+	static void checkpoint(SearchInfo& info) {
+		int lastSave = Timeman::get_time();
+
+		while (!info.stopped) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+			if (Timeman::get_time() - lastSave >= CheckpointInterval * 1000) {
+				TT.save_file(HashFile);
+				lastSave = Timeman::get_time();
+			}
+		}
+	}
+
+	// set_threads() creates or destroys helpers, so that there is one for
+	// every search thread after the main one. It must not be called while
+	// searching.
+	void set_threads(int threads) {
+		Threads = threads;
+
+		while (int(Helpers.size()) > Threads - 1)
+			Helpers.pop_back();
+
+		while (int(Helpers.size()) < Threads - 1)
+			Helpers.push_back(std::unique_ptr<Helper>(new Helper(int(Helpers.size()) + 1)));
+	}
+
+	// clear() makes the helpers forget their move ordering tables, for a new
+	// game
+	void clear() {
+		for (std::unique_ptr<Helper>& helper : Helpers)
+			helper->ctx.clear();
+	}
+
+	void start(Position& pos, SearchInfo& info) {
+		std::thread checkpointThread;
+
+		// Prepare for search
+		clear_for_search(pos, info);
+		TT.new_search();
+		info.threadId = 0;
+		info.mainInfo = nullptr;
+
+		// Lazy SMP, wake the helpers up on a copy of the root position
+		assert(Threads - 1 <= int(Helpers.size()));
+
+		for (int i = 0; i < Threads - 1; ++i)
+			Helpers[i]->start(pos, info);
+
+		if (CheckpointInterval > 0 && !HashFile.empty())
+			checkpointThread = std::thread(checkpoint, std::ref(info));
+
+		// Iterative deepening
+		iterative_deepening(pos, info);
+
+		// Stop the helper threads, they poll the main thread's stop signal.
+		info.stopped = true;
+		for (int i = 0; i < Threads - 1; ++i)
+			Helpers[i]->wait();
+
+		if (checkpointThread.joinable())
+			checkpointThread.join();
+
+		// Vote for the best move. Every thread votes for its best move, the vote
+		// is weighted by the score relative to the worst thread and the depth.
+		if (Threads > 1) {
+			Value minValue = VALUE_INFINITE;
+			Move bestMove = pos.context().best_move();
+			long bestVote = 0;
+
+			for (int i = 0; i < Threads; ++i) {
+				const SearchInfo& voter = i ? Helpers[i - 1]->info : info;
+
+				if (voter.completedDepth)
+					minValue = std::min(minValue, voter.bestValue);
+			}
+
+			for (int i = 0; i < Threads; ++i) {
+				const SearchInfo& voter = i ? Helpers[i - 1]->info : info;
+				Move voterMove = i ? Helpers[i - 1]->ctx.best_move() : pos.context().best_move();
+				long vote = 0;
+
+				if (!voter.completedDepth)
+					continue;
+
+				for (int j = 0; j < Threads; ++j) {
+					const SearchInfo& other = j ? Helpers[j - 1]->info : info;
+					Move otherMove = j ? Helpers[j - 1]->ctx.best_move() : pos.context().best_move();
+
+					if (other.completedDepth && otherMove == voterMove)
+						vote += long(other.bestValue - minValue + 14) * int(other.completedDepth);
+				}
+
+				if (vote > bestVote) {
+					bestVote = vote;
+					bestMove = voterMove;
+				}
+			}
+
+			pos.context().best_move_set(bestMove);
 		}
 
 		// Inform interface that we have stopped searching.
 		// Report best move.
-		info.stopped = true;
 		UCI::report_best_move(pos, info);
 	}
 }
\ No newline at end of file
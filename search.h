@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 #include "position.h"
 #include "utils/defs.h"
 
@@ -20,5 +22,17 @@ namespace Search {
 	constexpr int WindowSize = 14;
 	constexpr Depth WindowDepth = Depth(5);
 
+	constexpr int MaxThreads = 128;
+
+	// Number of search threads, the main thread and Threads - 1 helpers
+	extern int Threads;
+
+	// The transposition table is written to HashFile every CheckpointInterval
+	// seconds during a search, 0 disables checkpoints.
+	extern int CheckpointInterval;
+	extern std::string HashFile;
+
+	void set_threads(int threads);
+	void clear();
 	void start(Position& pos, SearchInfo& info);
 }
\ No newline at end of file
@@ -0,0 +1,20 @@
+#include <cstring>
+
+#include "searchcontext.h"
+
+// SearchContext::clear() forgets what the previous search learned about move
+// ordering and its principal variation. The evaluation caches stay valid, they
+// only depend on the keys.
+void SearchContext::clear() {
+	std::memset(historyMoves_, 0, sizeof(historyMoves_));
+	std::memset(killerMoves_, 0, sizeof(killerMoves_));
+	std::memset(captureHistory_, 0, sizeof(captureHistory_));
+	new_search();
+}
+
+// SearchContext::new_search() forgets the best move and the principal
+// variation, they belong to the position searched before.
+void SearchContext::new_search() {
+	bestMoveRoot_ = MOVE_NONE;
+	pvLength_[0] = pvSavedLength_ = 0;
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "material.h"
+#include "nnue.h"
+#include "pawns.h"
+#include "position.h"
+#include "utils/defs.h"
+
+// SearchContext is the per-thread data of a search. It owns the state and
+// accumulator stacks the thread's position is played on, the move lists of
+// the search stack, the move ordering tables, the best root move and the
+// evaluation caches. Each Lazy SMP thread has its own context, so none of it
+// is ever written by two threads at once.
+class SearchContext {
+public:
+	// Resets the move ordering tables, the best move and the PV
+	void clear();
+
+	// Resets the best move and the PV, for a search of another position
+	void new_search();
+
+	// Principal variation
+	Move best_move() const;
+	void best_move_set(Move m);
+
+	// Triangular PV table. pv_clear() empties the line of a PV node when it is
+	// entered, pv_update() prepends a new best move to the line of its child,
+	// and pv_save() keeps the root line once an iteration has completed.
+	void pv_clear(int ply);
+	void pv_update(int ply, Move m);
+	void pv_save();
+
+	// Principal variation of the last completed iteration
+	const Move* pv() const;
+	int pv_length() const;
+
+	// Move list of the given ply, preallocated for the search
+	Movelist& move_list(int ply);
+
+	// Move ordering, non captures
+	Order history_move(Color c, Move move) const;
+	void history_move_set(Color c, Move move, Order incr);
+	Move killer_move1(int ply) const;
+	Move killer_move2(int ply) const;
+	void killer_move_set(int ply, Move m);
+
+	// Move ordering, captures
+	Order capture_history(const Position& pos, Move move) const;
+	void capture_history_update(const Position& pos, Move move, int bonus);
+
+	// Pawn and material hash tables
+	Pawns::Table& pawns_table();
+	Material::Table& material_table();
+
+private:
+	friend class Position;
+
+	// State and accumulator stacks, indexed by the game ply. They hold the
+	// game and the search plies after it, Position::reserve() grows them for
+	// longer games.
+	std::vector<StateInfo> states_ = std::vector<StateInfo>(MAX_GAMELENGTH + DEPTH_MAX + 1);
+	std::vector<NNUE::Accumulator> accumulators_ = std::vector<NNUE::Accumulator>(MAX_GAMELENGTH + DEPTH_MAX + 1);
+
+	// Move lists of the search stack, one per search ply. They are allocated
+	// once, so that a node does not construct and initialize its own list.
+	std::vector<Movelist> moveLists_ = std::vector<Movelist>(DEPTH_MAX + 1);
+
+	Move bestMoveRoot_ = MOVE_NONE;
+
+	// Triangular PV table, the line of each ply starts at pvTable_[ply][0]
+	Move pvTable_[DEPTH_MAX + 1][DEPTH_MAX + 1] = {};
+	int pvLength_[DEPTH_MAX + 1] = {};
+	Move pv_[DEPTH_MAX + 1] = {};
+	int pvSavedLength_ = 0;
+
+	// Move ordering, non captures
+	Order historyMoves_[COLOR_NB][SQUARE_NB][SQUARE_NB] = {}; // [color][sq][sq]
+	Move killerMoves_[2][DEPTH_MAX] = {}; // [killercount == 2][ply]
+
+	// Move ordering, captures
+	Order captureHistory_[PIECETYPE_NB][SQUARE_NB][PIECETYPE_NB] = {}; // [moved][to][captured]
+
+	Pawns::Table pawnsTable_;
+	Material::Table materialTable_;
+};
+
+inline Move SearchContext::best_move() const {
+	return bestMoveRoot_;
+}
+
+inline void SearchContext::best_move_set(Move m) {
+	bestMoveRoot_ = m;
+}
+
+inline void SearchContext::pv_clear(int ply) {
+	assert(ply <= DEPTH_MAX);
+	pvLength_[ply] = 0;
+}
+
+inline void SearchContext::pv_update(int ply, Move m) {
+	assert(ply < DEPTH_MAX);
+	pvTable_[ply][0] = m;
+	std::copy(pvTable_[ply + 1], pvTable_[ply + 1] + pvLength_[ply + 1], pvTable_[ply] + 1);
+	pvLength_[ply] = pvLength_[ply + 1] + 1;
+}
+
+inline void SearchContext::pv_save() {
+	std::copy(pvTable_[0], pvTable_[0] + pvLength_[0], pv_);
+	pvSavedLength_ = pvLength_[0];
+}
+
+inline const Move* SearchContext::pv() const {
+	return pv_;
+}
+
+inline int SearchContext::pv_length() const {
+	return pvSavedLength_;
+}
+
+inline Movelist& SearchContext::move_list(int ply) {
+	assert(ply <= DEPTH_MAX);
+	return moveLists_[ply];
+}
+
+inline Order SearchContext::history_move(Color c, Move move) const {
+	return historyMoves_[c][from_sq(move)][to_sq(move)];
+}
+
+inline void SearchContext::history_move_set(Color c, Move move, Order incr) {
+	historyMoves_[c][from_sq(move)][to_sq(move)] += incr;
+}
+
+inline Move SearchContext::killer_move1(int ply) const {
+	return killerMoves_[0][ply];
+}
+
+inline Move SearchContext::killer_move2(int ply) const {
+	return killerMoves_[1][ply];
+}
+
+inline void SearchContext::killer_move_set(int ply, Move m) {
+	killerMoves_[1][ply] = killerMoves_[0][ply];
+	killerMoves_[0][ply] = m;
+}
+
+inline Order SearchContext::capture_history(const Position& pos, Move move) const {
+	return captureHistory_[pos.moved_piece(move)][to_sq(move)][pos.captured_piece(move)];
+}
+
+// capture_history_update() applies a bonus or a malus to a capture. The entry
+// is pulled back towards zero as it grows, so that it stays within
+// [-CaptureHistoryMax, CaptureHistoryMax] and never reorders capture victims.
+inline void SearchContext::capture_history_update(const Position& pos, Move move, int bonus) {
+	Order& entry = captureHistory_[pos.moved_piece(move)][to_sq(move)][pos.captured_piece(move)];
+
+	assert(abs(bonus) <= CaptureHistoryMax);
+	entry += Order(bonus - entry * abs(bonus) / CaptureHistoryMax);
+}
+
+inline Pawns::Table& SearchContext::pawns_table() {
+	return pawnsTable_;
+}
+
+inline Material::Table& SearchContext::material_table() {
+	return materialTable_;
+}
\ No newline at end of file
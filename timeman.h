@@ -15,6 +15,10 @@ namespace Timeman {
 			if (info.timeSet == true && Timeman::get_time() > info.stopTime) {
 				info.stopped = true;
 			}
+
+			if (info.mainInfo && info.mainInfo->stopped) {
+				info.stopped = true;
+			}
 		}
 	}
 }
@@ -1,51 +1,322 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
 #include "tt.h"
+#include "search.h"
 
 TranspositionTable TT;
 
-TranspositionTable::TranspositionTable() {
-	entryCount_ = size_ / sizeof(TTEntry);
-	entryCount_ -= 2;
-	table_ = (TTEntry *)malloc(entryCount_ * sizeof(TTEntry));
-	clear();
+namespace {
+
+	// Header of a saved table. The clusters follow it as raw memory, so a file
+	// is only valid for builds with the same entry layout.
+	struct TTFileHeader {
+		char magic[4];
+		uint32_t version;
+		uint64_t clusterCount;
+		Key zobristCheck; // Keys must match the ones the table was built with
+		uint8_t generation;
+		char padding[7];
+	};
+
+	constexpr char TTFileMagic[4] = { 'C', '1', 'T', 'T' };
+	constexpr uint32_t TTFileVersion = 2;
+
+	// Maps a whole file read-only into memory. Returns nullptr on failure.
+	const char* map_file(const std::string& path, size_t& size) {
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+								  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return nullptr;
+
+		LARGE_INTEGER fileSize;
+		HANDLE mapping = GetFileSizeEx(file, &fileSize) && fileSize.QuadPart
+					   ? CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+		CloseHandle(file);
+
+		if (!mapping)
+			return nullptr;
+
+		void* mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		size = size_t(fileSize.QuadPart);
+		return static_cast<const char*>(mem);
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd == -1)
+			return nullptr;
+
+		struct stat st;
+		void* mem = fstat(fd, &st) == 0 && st.st_size
+				  ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		close(fd);
+
+		if (mem == MAP_FAILED)
+			return nullptr;
+
+		madvise(mem, st.st_size, MADV_SEQUENTIAL);
+		size = size_t(st.st_size);
+		return static_cast<const char*>(mem);
+#endif
+	}
+
+	void unmap_file(const char* mem, size_t size) {
+#if defined(_WIN32)
+		UnmapViewOfFile(mem);
+#else
+		munmap(const_cast<char*>(mem), size);
+#endif
+	}
+
+#if defined(__linux__)
+	constexpr int MPOL_INTERLEAVE_ = 3; // From <numaif.h>, which needs libnuma
+
+	// Every search thread probes the whole table, so on multi-socket hosts its
+	// pages are interleaved over all NUMA nodes. Otherwise they would all land
+	// on the node of whichever thread touches them first.
+	void interleave_numa(void* mem, size_t size) {
+		std::ifstream nodes("/sys/devices/system/node/online");
+		std::string online;
+
+		if (!(nodes >> online))
+			return;
+
+		// The file lists node ranges, such as "0" or "0-3"
+		int maxNode = std::stoi(online.substr(online.find_last_of("-,") + 1));
+		if (maxNode <= 0 || maxNode >= 64)
+			return;
+
+		unsigned long mask = (2UL << maxNode) - 1;
+		syscall(SYS_mbind, mem, size, MPOL_INTERLEAVE_, &mask, maxNode + 2, 0);
+	}
+#endif
+
+	// Allocates the table aligned to the page size, backed by huge pages
+	// where the OS allows it. The memory is not touched here.
+	void* aligned_large_pages_alloc(size_t size) {
+#if defined(_WIN32)
+		return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#elif defined(__linux__)
+		constexpr size_t alignment = 2 * 1024 * 1024; // Transparent huge page size
+		size = (size + alignment - 1) / alignment * alignment;
+		void* mem = aligned_alloc(alignment, size);
+
+		if (mem) {
+			madvise(mem, size, MADV_HUGEPAGE);
+			interleave_numa(mem, size);
+		}
+		return mem;
+#else
+		constexpr size_t alignment = 4096;
+		return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+	}
+
+	void aligned_large_pages_free(void* mem) {
+#if defined(_WIN32)
+		if (mem)
+			VirtualFree(mem, 0, MEM_RELEASE);
+#else
+		free(mem);
+#endif
+	}
 }
 
-void TranspositionTable::clear() {
-	TTEntry* entry;
+// TTEntry::save() populates the TTEntry with a new node's data, possibly
+// overwriting an old position. Update is not atomic and can be racy.
+void TTEntry::save(Key k, Value v, Bound b, Depth d, Move m, Value ev) {
+	// Preserve any existing move for the same position
+	if (m || (k >> 48) != key16)
+		move16 = uint16_t(m);
 
-	for (entry = table_; entry < table_ + entryCount_; entry++) {
-		entry->posKey = 0ULL;
-		entry->move = MOVE_NONE;
-		entry->depth = DEPTH_ZERO;
-		entry->value = VALUE_NONE;
-		entry->bound = BOUND_NONE;
+	// Overwrite less valuable entries
+	if (   (k >> 48) != key16
+		|| d > depth8 - 4
+		|| b == BOUND_EXACT)
+	{
+		key16     = uint16_t(k >> 48);
+		value16   = int16_t(v);
+		eval16    = int16_t(ev);
+		genBound8 = uint8_t(TT.generation() | b);
+		depth8    = uint8_t(d);
 	}
 }
 
-void TranspositionTable::save(const Key posKey, const Move move, const Value value, const Bound bound, const Depth depth) {
-	unsigned long long index = posKey % entryCount_;
+TranspositionTable::~TranspositionTable() {
+	free_table();
+}
 
-	TTEntry* replace = &table_[index];
+void TranspositionTable::free_table() {
+	aligned_large_pages_free(table_);
+	table_ = nullptr;
+	clusterCount_ = 0;
+}
 
-	// Don't overwrite an entry from the same position, unless we have
-	// an exact bound or depth that is nearly as good as the old one
-	if (replace->bound != BOUND_NONE
-		|| (bound != BOUND_EXACT
-			&&  replace->posKey == posKey
-			&& depth < replace->depth - 3))
+// TranspositionTable::resize() sets the size of the transposition table,
+// measured in megabytes. The memory is released now and allocated again
+// only when the table is next needed.
+void TranspositionTable::resize(size_t mbSize) {
+	if (mbSize == mbSize_)
 		return;
 
-	table_[index].move = move;
-	table_[index].posKey = posKey;
-	table_[index].bound = bound;
-	table_[index].depth = depth;
-	table_[index].value = value;
+	free_table();
+	mbSize_ = mbSize;
 }
 
-TTEntry* TranspositionTable::probe(Key key, bool& found) const {
-	unsigned long long index = key % entryCount_;
+// TranspositionTable::allocate() allocates and clears the table if this has
+// not been done yet. It is called from "isready" and "go", so an
+// engine that never searches never pays for the memory.
+void TranspositionTable::allocate() {
+	if (table_)
+		return;
+
+	clusterCount_ = mbSize_ * 1024 * 1024 / sizeof(Cluster);
+	table_ = static_cast<Cluster*>(aligned_large_pages_alloc(clusterCount_ * sizeof(Cluster)));
+
+	if (!table_) {
+		std::cerr << "Failed to allocate " << mbSize_ << "MB for transposition table." << std::endl;
+		exit(EXIT_FAILURE);
+	}
 
-	if (table_[index].posKey == key)
-		return found = true, &table_[index];
+	clear();
+}
+
+// TranspositionTable::clear() zeroes the table in parallel, one slice per
+// search thread. On NUMA hosts first touch also places the pages.
+void TranspositionTable::clear() {
+	generation8_ = 0;
+
+	if (!table_)
+		return;
+
+	const size_t threads = Search::Threads;
+	std::vector<std::thread> workers;
+
+	for (size_t idx = 0; idx < threads; ++idx)
+		workers.emplace_back([this, idx, threads]() {
+			const size_t stride = clusterCount_ / threads,
+						 start  = stride * idx,
+						 len    = idx != threads - 1 ? stride : clusterCount_ - start;
+
+			std::memset(&table_[start], 0, len * sizeof(Cluster));
+		});
+
+	for (std::thread& t : workers)
+		t.join();
+}
+
+// TranspositionTable::probe() looks up the current position in the transposition
+// table. It returns true and a pointer to the TTEntry if the position is found.
+// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
+// to be replaced later. The replace value of an entry is calculated as its depth
+// minus 8 times its relative age. TTEntry t1 is considered more valuable than
+// TTEntry t2 if its replace value is greater than that of t2.
+TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+	TTEntry* const tte = first_entry(key);
+	const uint16_t key16 = key >> 48; // Use the high 16 bits as key inside the cluster
+
+	for (int i = 0; i < ClusterSize; ++i)
+		if (!tte[i].key16 || tte[i].key16 == key16)
+		{
+			// Refresh the generation of an entry from an older search
+			tte[i].genBound8 = uint8_t(generation8_ | tte[i].bound());
+
+			return found = (bool)tte[i].key16, &tte[i];
+		}
+
+	// Find an entry to be replaced according to the replacement strategy
+	TTEntry* replace = tte;
+	for (int i = 1; i < ClusterSize; ++i)
+		// Due to our packed storage format for generation and its cyclic
+		// nature we add 259 (256 is the modulus plus 3 to keep the lowest
+		// two bound bits from affecting the result) to calculate the entry
+		// age correctly even after generation8 overflows into the next cycle.
+		if (  replace->depth8 - ((259 + generation8_ - replace->genBound8) & 0xFC) * 2
+			>   tte[i].depth8 - ((259 + generation8_ -   tte[i].genBound8) & 0xFC) * 2)
+			replace = &tte[i];
+
+	return found = false, replace;
+}
+
+// TranspositionTable::save_file() writes the table to a file, so that a long
+// analysis can later continue from it. It may be called during a search, the
+// entries being written concurrently are no more racy than normal probes.
+bool TranspositionTable::save_file(const std::string& path) const {
+	if (!table_)
+		return false;
+
+	TTFileHeader header = {};
+	std::memcpy(header.magic, TTFileMagic, sizeof(TTFileMagic));
+	header.version = TTFileVersion;
+	header.clusterCount = clusterCount_;
+	header.zobristCheck = Zobrist::side;
+	header.generation = generation8_;
+
+	// Write to a temporary file first, a crash during a checkpoint must not
+	// destroy the previous one.
+	const std::string tmpPath = path + ".tmp";
+	std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(table_), clusterCount_ * sizeof(Cluster));
+	file.close();
+
+	if (!file)
+		return false;
+
+	std::remove(path.c_str());
+	return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+// TranspositionTable::load_file() maps a file written by save_file() and
+// copies it into the table, resizing the table to the size of the file.
+bool TranspositionTable::load_file(const std::string& path) {
+	size_t size;
+	const char* mem = map_file(path, size);
+
+	if (!mem)
+		return false;
+
+	TTFileHeader header;
+	bool valid = size >= sizeof(header);
+
+	if (valid) {
+		std::memcpy(&header, mem, sizeof(header));
+
+		valid =  !std::memcmp(header.magic, TTFileMagic, sizeof(TTFileMagic))
+			  &&  header.version == TTFileVersion
+			  &&  header.zobristCheck == Zobrist::side
+			  &&  header.clusterCount
+			  &&  header.clusterCount * sizeof(Cluster) % (1024 * 1024) == 0
+			  &&  size == sizeof(header) + header.clusterCount * sizeof(Cluster);
+	}
+
+	if (valid) {
+		resize(header.clusterCount * sizeof(Cluster) / (1024 * 1024));
+		allocate();
+		std::memcpy(table_, mem + sizeof(header), clusterCount_ * sizeof(Cluster));
+		generation8_ = header.generation;
+	}
 
-	return found = false, &table_[index];
+	unmap_file(mem, size);
+	return valid;
 }
\ No newline at end of file
@@ -1,31 +1,100 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <xmmintrin.h> // Header for _mm_prefetch()
+#endif
+
 #include "position.h"
 #include "utils/defs.h"
 
+// TTEntry struct is the transposition table entry, defined as below:
+//
+// key        16 bit
+// move       16 bit
+// value      16 bit
+// eval value 16 bit
+// depth       8 bit
+// generation  6 bit
+// bound type  2 bit
 struct TTEntry {
-	Bound bound;
-	Depth depth;
-	Value value;
-	Move move;
-	Key posKey;
+	Move  move()  const { return (Move )move16; }
+	Value value() const { return (Value)value16; }
+	Value eval()  const { return (Value)eval16; }
+	Depth depth() const { return (Depth)depth8; }
+	Bound bound() const { return (Bound)(genBound8 & 0x3); }
+	void save(Key k, Value v, Bound b, Depth d, Move m, Value ev);
+
+private:
+	friend class TranspositionTable;
+
+	uint16_t key16;
+	uint16_t move16;
+	int16_t  value16;
+	int16_t  eval16;
+	uint8_t  depth8;
+	uint8_t  genBound8;
 };
 
+// A TranspositionTable consists of a power of 2 number of clusters and each
+// cluster consists of ClusterSize number of TTEntry. Each non-empty entry
+// contains information of exactly one position. The size of a cluster should
+// divide the size of a cache line size, to ensure that clusters never cross
+// cache lines. This ensures best cache performance, as the cacheline is
+// prefetched, as soon as possible.
 class TranspositionTable {
+
+	static constexpr int CacheLineSize = 64;
+	static constexpr int ClusterSize = 6;
+
+	struct Cluster {
+		TTEntry entry[ClusterSize];
+		char padding[4]; // Align to a divisor of the cache line size
+	};
+
+	static_assert(CacheLineSize % sizeof(Cluster) == 0, "Cluster size incorrect");
+
 public:
-	TranspositionTable();
-	~TranspositionTable() { free(mem_); }
+	static constexpr int DefaultHashMb = 96;
+	static constexpr int MaxHashMb = 65536;
 
+	~TranspositionTable();
+
+	void new_search() { generation8_ += 4; } // Lower 2 bits are used by Bound
+	uint8_t generation() const { return generation8_; }
+	void resize(size_t mbSize);
+	void allocate();
 	void clear();
-	void save(const Key posKey, const Move move, const Value value, const Bound bound, const Depth depth);
-	TTEntry* probe(Key key, bool& found) const;
+	bool save_file(const std::string& path) const;
+	bool load_file(const std::string& path);
+	size_t hash_mb() const { return mbSize_; }
+	TTEntry* probe(const Key key, bool& found) const;
+
+	TTEntry* first_entry(const Key key) const {
+		// Multiply-shift maps the lower 32 bits of the key to a cluster index,
+		// avoiding the division of a modulo.
+		return &table_[(uint32_t(key) * uint64_t(clusterCount_)) >> 32].entry[0];
+	}
+
+	// prefetch() loads the cluster of the given key into the cache without
+	// waiting for it, so that the later probe does not stall on memory.
+	void prefetch(const Key key) const {
+#if defined(_MSC_VER)
+		_mm_prefetch((char*)first_entry(key), _MM_HINT_T0);
+#else
+		__builtin_prefetch(first_entry(key));
+#endif
+	}
 
 private:
-	TTEntry* table_;
-	void* mem_;
-	unsigned long long entryCount_;
+	void free_table();
 
-	const unsigned long long size_ = 0x6000000;
+	Cluster* table_ = nullptr;
+	size_t clusterCount_ = 0;
+	size_t mbSize_ = DefaultHashMb;
+	uint8_t generation8_ = 0; // Size must be not bigger than TTEntry::genBound8
 };
 
 extern TranspositionTable TT;
\ No newline at end of file
@@ -1,32 +1,46 @@
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <stdio.h>
 #include <thread>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "uci.h"
 #include "tt.h"
 #include "timeman.h"
 #include "search.h"
+#include "searchcontext.h"
 #include "bitboard.h"
 #include "movegen.h"
-#include "psqt.h"
+#include "endgame.h"
+#include "nnue.h"
+#include "utils/bench.h"
+#include "utils/cpu.h"
 #include "utils/perft.h"
 #include "utils/typeconvertions.h"
 
 using namespace std;
 
 
+// Lookup tables, Zobrist keys and cuckoo tables are computed by the compiler.
+// Only the slider attacks, which depend on the processor, and the endgame
+// keys are set up here.
 void main() {
+	CPU::init();
 	BB::init();
-	Movegen::init_mvvlva();
-	Zobrist::init_keys();
-	PSQT::init();
+	Endgames::init();
 	
 	UCI::loop();
 }
 
+// parse_move() converts a move in coordinate notation to a move of the
+// current position, or MOVE_NONE if it is not legal there. The move type is
+// read from the board, and the move is checked with pseudo_legal() and
+// legal(), so no moves are generated.
 Move parse_move(Position& pos, string moveStr) {
+	if (moveStr.length() < 4) return MOVE_NONE;
 	if (moveStr[1] > '8' || moveStr[1] < '1') return MOVE_NONE;
 	if (moveStr[3] > '8' || moveStr[3] < '1') return MOVE_NONE;
 	if (moveStr[0] > 'h' || moveStr[0] < 'a') return MOVE_NONE;
@@ -34,50 +48,138 @@ Move parse_move(Position& pos, string moveStr) {
 
 	Square from = TypeConvertions::str_to_sq(moveStr.substr(0, 2));
 	Square to = TypeConvertions::str_to_sq(moveStr.substr(2, 2));
+	PieceType pt = pos.piece_on_sq(from);
+	Move move;
 
-	Movelist list = Movelist();
-	Movegen::get_moves(pos, list);
-	int moveNum = 0;
-	Move move = MOVE_NONE;
-	PieceType promPce = PIECETYPE_NONE;
-
-	for (moveNum = 0; moveNum < list.count; ++moveNum) {
-		move = list.moves[moveNum].move;
-		if (from_sq(move) == from && to_sq(move) == to) {
-			promPce = promoted_piece(move);
-			if (promPce != PIECETYPE_NONE) {
-				if (promPce == ROOK && moveStr.back() == 'r') {
-					return move;
-				}
-				else if (promPce == BISHOP && moveStr.back() == 'b') {
-					return move;
-				}
-				else if (promPce == QUEEN && moveStr.back() == 'q') {
-					return move;
-				}
-				else if (promPce == KNIGHT && moveStr.back() == 'n') {
-					return move;
-				}
-				continue;
-			}
-			return move;
-		}
-	}
+	if (moveStr.length() > 4) {
+		size_t prom = string("nbrq").find(moveStr[4]);
+
+		if (prom == string::npos) return MOVE_NONE;
 
-	return MOVE_NONE;
+		move = make<PROMOTION>(from, to, PieceType(KNIGHT + prom));
+	}
+	else if (pt == KING && distance<File>(from, to) == 2)
+		move = make<CASTLING>(from, to);
+	else if (pt == PAWN && to == pos.en_passant())
+		move = make<ENPASSANT>(from, to);
+	else
+		move = make_move(from, to);
+
+	return pos.pseudo_legal(move) && pos.legal(move) ? move : MOVE_NONE;
 }
 
 const string StartFEN = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
 std::thread SearchThread;
 
+// The game the board was last set to: the FEN of its starting position and
+// the moves played from there. A GUI sends the whole game again with every
+// move, so a position command that repeats it and appends a few moves only
+// plays the new ones.
+string GameFen;
+vector<string> GameMoves;
+
+// new_game() sets the board to a FEN with no moves played
+static void new_game(Position& pos, const string& fen) {
+	pos.set(fen);
+	GameFen = fen;
+	GameMoves.clear();
+}
+
 namespace UCI{
 
 	void uci() {
 		cout << "id name ChallengerOne" << endl;
 		cout << "id author VK" << endl;
+		cout << "option name Hash type spin default " << TranspositionTable::DefaultHashMb
+			 << " min 1 max " << TranspositionTable::MaxHashMb << endl;
+		cout << "option name Threads type spin default 1 min 1 max " << Search::MaxThreads << endl;
+		cout << "option name HashFile type string default <empty>" << endl;
+		cout << "option name HashCheckpoint type spin default 0 min 0 max 86400" << endl;
+		cout << "option name EvalFile type string default <empty>" << endl;
+		cout << "option name Use NNUE type check default false" << endl;
+		cout << "option name Compact Attacks type check default false" << endl;
 		cout << "uciok" << endl;
 	}
 
+	void setoption(istringstream& is) {
+		string token, name, value;
+
+		is >> token; // Consume "name" token
+
+		// Read option name (can contain spaces)
+		while (is >> token && token != "value")
+			name += (name.empty() ? "" : " ") + token;
+
+		// Read option value (can contain spaces)
+		while (is >> token)
+			value += (value.empty() ? "" : " ") + token;
+
+		if (name == "Hash") {
+			try {
+				TT.resize(std::max(1, std::min(TranspositionTable::MaxHashMb, stoi(value))));
+			}
+			catch (const invalid_argument exception) {
+				cout << "info string invalid value for option " << name << endl;
+			}
+		}
+		else if (name == "Threads") {
+			try {
+				Search::set_threads(std::max(1, std::min(Search::MaxThreads, stoi(value))));
+			}
+			catch (const invalid_argument exception) {
+				cout << "info string invalid value for option " << name << endl;
+			}
+		}
+		else if (name == "HashFile")
+			Search::HashFile = value == "<empty>" ? "" : value;
+		else if (name == "HashCheckpoint") {
+			try {
+				Search::CheckpointInterval = std::max(0, stoi(value));
+			}
+			catch (const invalid_argument exception) {
+				cout << "info string invalid value for option " << name << endl;
+			}
+		}
+		else if (name == "EvalFile") {
+			if (NNUE::load(value))
+				cout << "info string network loaded from " << value << endl;
+			else
+				cout << "info string could not load network from " << value << endl;
+		}
+		else if (name == "Use NNUE")
+			NNUE::use(value == "true");
+		else if (name == "Compact Attacks")
+			BB::use_compact(value == "true");
+		else
+			cout << "info string unknown option " << name << endl;
+	}
+
+	// savehash and loadhash write the transposition table to a file and read
+	// it back. The file defaults to the HashFile option.
+	void savehash(istringstream& is) {
+		string path;
+
+		if (!(is >> path))
+			path = Search::HashFile;
+
+		if (TT.save_file(path))
+			cout << "info string hash saved to " << path << endl;
+		else
+			cout << "info string could not save hash to " << path << endl;
+	}
+
+	void loadhash(istringstream& is) {
+		string path;
+
+		if (!(is >> path))
+			path = Search::HashFile;
+
+		if (TT.load_file(path))
+			cout << "info string hash loaded from " << path << ", " << TT.hash_mb() << " MB" << endl;
+		else
+			cout << "info string could not load hash from " << path << endl;
+	}
+
 	void go_perft(Position& pos, istringstream& is) {
 		string token;
 		unsigned int depth;
@@ -85,7 +187,7 @@ namespace UCI{
 		is >> token;
 		is >> depth;
 
-		if (token == "auto") Perft::perft_auto(pos, depth);
+		if (token == "auto") Perft::perft_auto(depth);
 		else {
 			try {
 				depth = stoi(token);
@@ -136,13 +238,13 @@ namespace UCI{
 		<< " stop:" << info.stopTime << " depth:" << info.depth
 		<< " timeset:" << info.timeSet << endl;
 		
+		TT.allocate();
 		SearchThread = thread(Search::start, std::ref(pos), std::ref(info));
 	}
 
 	void position(Position& pos, istringstream& is) {
-		Move move;
+		vector<string> moves;
 		string token, fen;
-		pos.his_ply_reset();
 
 		is >> token;
 		if (token == "startpos")
@@ -156,21 +258,46 @@ namespace UCI{
 		else
 			return;
 
-		pos.set(fen);
-		
-		while (is >> token && (move = parse_move(pos, token)) != MOVE_NONE)
+		while (is >> token)
+			moves.push_back(token);
+
+		bool extendsGame = fen == GameFen
+						&& moves.size() >= GameMoves.size()
+						&& equal(GameMoves.begin(), GameMoves.end(), moves.begin());
+
+		if (!extendsGame)
+			new_game(pos, fen);
+
+		pos.reserve(int(moves.size()));
+
+		// Play the moves that are not on the board yet, up to the first illegal one
+		for (size_t i = GameMoves.size(); i < moves.size(); ++i)
 		{
+			Move move = parse_move(pos, moves[i]);
+
+			if (move == MOVE_NONE)
+				break;
+
 			pos.do_move(move);
+			GameMoves.push_back(moves[i]);
 		}
 		pos.ply_reset();
 	}
 
+	void bench(SearchInfo& info, istringstream& is) {
+		int depth = Bench::DefaultDepth;
+
+		is >> depth;
+		Bench::bench(info, std::max(1, depth));
+	}
+
 	void ucinewgame(Position& pos, SearchInfo& info) {
 		info = SearchInfo();
-		pos = Position();
+		pos.context().clear();
+		Search::clear();
 		info.quit = false;
 		info.stopped = false;
-		pos.set(StartFEN);
+		new_game(pos, StartFEN);
 		TT.clear();
 	}
 
@@ -184,13 +311,14 @@ namespace UCI{
 	void loop() {
 		string token, cmd;
 		SearchInfo info = SearchInfo();
-		Position pos = Position();
+		SearchContext ctx;
+		Position pos(ctx);
 
 		uci();
 
 		info.quit = false;
 		info.stopped = false;
-		pos.set(StartFEN);
+		new_game(pos, StartFEN);
 
 		while (true) 
 		{
@@ -207,19 +335,27 @@ namespace UCI{
 			if (token == "quit") {
 				info.quit = true;
 				stop(pos, info);
+				Search::set_threads(1);
 				break; 
 			}
 			else if (token == "stop") stop(pos, info);
 			else if (token == "uci") uci();
-			else if (token == "isready") cout << "readyok" << endl;
+			else if (token == "isready") {
+				TT.allocate();
+				cout << "readyok" << endl;
+			}
 			else if (token == "go") go(pos, info, is);
 			else if (token == "position") position(pos, is);
+			else if (token == "setoption") setoption(is);
 			else if (token == "ucinewgame") ucinewgame(pos, info);
 			else if (token == "print") pos.print();
+			else if (token == "savehash") savehash(is);
+			else if (token == "loadhash") loadhash(is);
+			else if (token == "bench") bench(info, is);
 		}
 	}
 
-	void report(Position& pos, SearchInfo& info, Depth depth, Value eval) {
+	void report(Position& pos, SearchInfo& info, Depth depth, Value eval, uint64_t nodes) {
 		// If the score is MATE or MATED in X, convert to X
 		Value score = eval >= VALUE_MATE_IN_MAX_PLY ? (VALUE_MATE - eval + 1) / 2
 					: eval <= VALUE_MATED_IN_MAX_PLY ? -(eval + VALUE_MATE) / 2 : eval;
@@ -232,14 +368,13 @@ namespace UCI{
 		auto time = Timeman::get_time() - info.startTime;
 		
 		// Nodes per second
-		auto nps = info.nodes / (time <= 0 ? 1 : time);
-		nps *= 1000;
+		uint64_t nps = 1000 * nodes / (time <= 0 ? 1 : time);
 
 		// Do reporting
 		std::cout << "info"
 				  << " depth " << depth
 			 	  << " score " << type << score
-				  << " nodes " << info.nodes
+				  << " nodes " << nodes
 				  << " time " << time
 				  << " nps " << nps
 				  << " pv ";
@@ -249,7 +384,7 @@ namespace UCI{
 	void report_best_move(Position& pos, SearchInfo& info) {
 		info.stopped = true;
 		std::cout << "bestmove " 
-				  << TypeConvertions::move_to_string(pos.best_move()) 
+				  << TypeConvertions::move_to_string(pos.context().best_move()) 
 				  << std::endl;
 	}
 }
\ No newline at end of file
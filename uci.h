@@ -5,6 +5,6 @@
 
 namespace UCI {
 	void loop();
-	void report(Position& pos, SearchInfo& info, Depth depth, Value eval);
+	void report(Position& pos, SearchInfo& info, Depth depth, Value eval, uint64_t nodes);
 	void report_best_move(Position& pos, SearchInfo& info);
 }
\ No newline at end of file
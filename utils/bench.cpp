@@ -0,0 +1,65 @@
+#include <iostream>
+#include <string>
+
+#include "bench.h"
+#include "cpu.h"
+#include "../bitboard.h"
+#include "../position.h"
+#include "../search.h"
+#include "../searchcontext.h"
+#include "../timeman.h"
+#include "../tt.h"
+
+namespace Bench {
+
+	// Tactical middlegame positions, with many captures to resolve, so that a
+	// large share of the nodes is spent in the quiescence search.
+	const std::string Fens[] = {
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+		"4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+		"r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+		"r1bbk1nr/pp3p1p/2n5/1N4p1/2Np1B2/8/PPP2PPP/2KR1B1R w kq - 0 13",
+		"r1bq1rk1/ppp1nppp/4n3/3p3Q/3P4/1BP1B3/PP1N2PP/R4RK1 w - - 1 16",
+		"4r1k1/r1q2ppp/ppp2n2/4P3/5Rb1/1N1BQ3/PPP3PP/R5K1 w - - 1 17",
+		"2rqkb1r/ppp2p2/2npb1p1/1N1Nn2p/2P1PP2/8/PP2B1PP/R1BQK2R b KQ - 0 11",
+		"r1bq1r1k/b1p1npp1/p2p3p/1p6/3PP3/1B2NN2/PP3PPP/R2Q1RK1 w - - 1 16",
+		"3r1rk1/p5pp/bpp1pp2/8/q1PP1P2/b3P3/P2NQRPP/1R2B1K1 b - - 6 22",
+		"r1q2rk1/2p1bppp/2Pp4/p6b/Q1PNp3/4B3/PP1R1PPP/2K4R w - - 2 18"
+	};
+
+	// Bench::bench() searches every position to a fixed depth with a single
+	// thread and an empty hash table, and reports the total nodes and speed,
+	// along with the code paths picked for the processor.
+	// The node count is the same in every run, so it also shows whether a
+	// change altered the search.
+	void bench(SearchInfo& info, int depth) {
+		SearchContext ctx;
+		Position pos(ctx);
+		int threads = Search::Threads;
+		uint64_t nodes = 0;
+		int elapsed = 0;
+
+		Search::Threads = 1;
+		TT.allocate();
+		TT.clear();
+
+		for (const std::string& fen : Fens) {
+			pos.set(fen);
+
+			info.depth = depth;
+			info.timeSet = false;
+
+			Search::start(pos, info);
+
+			nodes += info.nodes;
+			elapsed += Timeman::get_time() - info.startTime;
+		}
+
+		Search::Threads = threads;
+
+		std::cout << "Backend         : " << CPU::backend() << (BB::CompactAttacks ? " compact" : "") << std::endl;
+		std::cout << "Total time (ms) : " << elapsed << std::endl;
+		std::cout << "Nodes searched  : " << nodes << std::endl;
+		std::cout << "Nodes/second    : " << 1000 * nodes / (elapsed > 0 ? elapsed : 1) << std::endl;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "defs.h"
+
+namespace Bench {
+	constexpr int DefaultDepth = 9;
+
+	void bench(SearchInfo& info, int depth);
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+#include "cpu.h"
+
+namespace CPU {
+
+	bool HasPopcnt = false;
+	bool HasBmi2 = false;
+	bool HasAvx2 = false;
+	bool HasFastPext = false;
+
+	// cpuid() fills regs with EAX, EBX, ECX and EDX of the given leaf
+	static void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4]) {
+#ifdef _MSC_VER
+		__cpuidex(reinterpret_cast<int*>(regs), int(leaf), int(subleaf));
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	// xgetbv() returns the register state enabled by the operating system
+	static unsigned long long xgetbv() {
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		unsigned eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return eax | (unsigned long long)edx << 32;
+#endif
+	}
+
+	void init() {
+		unsigned regs[4];
+		char vendor[13] = {};
+
+		cpuid(0, 0, regs);
+		unsigned maxLeaf = regs[0];
+		std::memcpy(vendor, &regs[1], 4);
+		std::memcpy(vendor + 4, &regs[3], 4);
+		std::memcpy(vendor + 8, &regs[2], 4);
+
+		cpuid(1, 0, regs);
+		unsigned family = (regs[0] >> 8) & 0xF;
+		if (family == 0xF)
+			family += (regs[0] >> 20) & 0xFF;
+
+		HasPopcnt = regs[2] & (1 << 23);
+
+		// AVX2 also needs the OS to save the YMM registers on context switches
+		bool osAvx = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && (xgetbv() & 6) == 6;
+
+		if (maxLeaf >= 7) {
+			cpuid(7, 0, regs);
+			HasBmi2 = regs[1] & (1 << 8);
+			HasAvx2 = osAvx && (regs[1] & (1 << 5));
+		}
+
+		// Zen 3 is family 19h, earlier Zen and Excavator microcode PEXT
+		HasFastPext = HasBmi2 && !(!std::strcmp(vendor, "AuthenticAMD") && family < 0x19);
+	}
+
+	std::string backend() {
+		return std::string(HasFastPext ? "pext" : "magic")
+			 + (HasPopcnt ? " popcnt" : "")
+			 + (HasAvx2 ? " avx2" : " sse2");
+	}
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+namespace CPU {
+
+	// Instruction set extensions of the processor the engine runs on, set by
+	// CPU::init() at startup. Until then they are all false, which selects the
+	// portable code paths.
+	extern bool HasPopcnt;
+	extern bool HasBmi2;
+	extern bool HasAvx2;
+
+	// HasFastPext is true when PEXT is implemented in hardware. AMD processors
+	// before Zen 3 support BMI2 but run PEXT in microcode, many times slower
+	// than a magic multiplication.
+	extern bool HasFastPext;
+
+	void init();
+
+	// backend() names the code paths picked from the detected features
+	std::string backend();
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <assert.h>
+#include <atomic>
+#include <cstdint>
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -10,9 +12,13 @@
 #include <x86intrin.h>
 #endif
 
+#include "cpu.h"
+
 typedef unsigned long long Bitboard;
 typedef unsigned long long Key;
 
+// Game plies the state and accumulator stacks hold before they are grown for
+// a longer game, the search plies come on top of them.
 constexpr int MAX_GAMELENGTH = 256;
 constexpr int MAX_POSITIONMOVES = 256;
 constexpr int MAX_PLY = 128;
@@ -27,7 +33,7 @@ enum Piece {
 	EMPTY, wP, wN, wB, wR, wQ, wK, bP, bN, bB, bR, bQ, bK 
 };
 
-enum PieceType { 
+enum PieceType : uint8_t {
 	PIECETYPE_NONE, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING, 
 	
 	PIECETYPE_ANY = 0,
@@ -79,6 +85,12 @@ enum Value : int {
 	MidgameLimit = 15258, EndgameLimit = 3915
 };
 
+enum ScaleFactor : int {
+	SCALE_FACTOR_DRAW = 0,
+	SCALE_FACTOR_NORMAL = 64,
+	SCALE_FACTOR_MAX = 128
+};
+
 enum Depth : int {
 	ONE_PLY = 1,
 
@@ -86,21 +98,24 @@ enum Depth : int {
 	DEPTH_MAX = MAX_PLY * ONE_PLY
 };
 
-enum Move : int {
+// A move needs 16 bits to be stored
+//
+// bit  0- 5: origin square (from 0 to 63)
+// bit  6-11: destination square (from 0 to 63)
+// bit 12-13: promotion piece type - KNIGHT (from 0 to 3)
+// bit 14-15: special move flag: promotion (1), en passant (2), castling (3)
+//
+// The moved and captured pieces are not part of the move, they are read from
+// the board with Position::moved_piece() and Position::captured_piece().
+enum Move : uint16_t {
 	MOVE_NONE
 };
 
-enum Flag : int {
-	// Move contains these flags explicitly
-	FLAG_NONE = 0,
-	FLAG_EP = 0x200000,
-	FLAG_PS = 0x400000,
-	FLAG_CASTLE = 0x8000000,
-
-	// Move contains these flags implicitly
-	FLAG_CAP = 0x38000,
-	FLAG_PROM = 0x1C0000,
-	FLAG_NOISY = 0x3F8000
+enum MoveType : int {
+	NORMAL,
+	PROMOTION = 1 << 14,
+	ENPASSANT = 2 << 14,
+	CASTLING  = 3 << 14
 };
 
 enum Order : int {
@@ -119,6 +134,10 @@ enum Order : int {
 	ORDER_TT      = 2000000
 };
 
+// Capture history stays within half of the MVV/LVA victim step, so that it
+// orders captures of the same victim but never a smaller victim first.
+constexpr int CaptureHistoryMax = 50;
+
 enum CastlingRight : int {
 	NO_CASTLING = 0,
 	WKCA = 1,
@@ -147,12 +166,26 @@ enum Phase : int {
 	PHASE_MID, PHASE_END, PHASE_NB
 };
 
-struct Undo {
-	Move move;
-	CastlingRight castlePerm;
-	Square enPas;
-	int fiftyMove;
+// StateInfo is one frame of the position's state stack. do_move() copies the
+// incrementally updated fields into the next frame and updates them there, so
+// undo_move() only has to restore the board and step back to the previous frame.
+struct StateInfo {
+	// Copied when making a move
 	Key posKey;
+	Key pawnKey;
+	Key materialKey;
+	Value psq[PHASE_NB];
+	Value nonPawnMaterial[COLOR_NB];
+	CastlingRight castlingRights;
+	int fiftyMove;
+	int pliesFromNull;
+	Square enPassant;
+
+	// Not copied when making a move (will be recomputed anyhow)
+	Move move;
+	PieceType capturedPiece;
+	Bitboard checkers;
+	Bitboard pinned;
 };
 
 struct MoveEntry {
@@ -165,6 +198,24 @@ struct Movelist {
 	int count = 0;
 };
 
+// Relaxed holds a value one thread writes while others read it, the stop flag
+// and the node counters of a search. Loads and stores are relaxed atomics, so
+// they cost no more than plain ones. ++ is not an atomic increment, only the
+// owning thread may use it. Copies take a snapshot of the value.
+template<typename T>
+struct Relaxed {
+	Relaxed(T v = T()) : value(v) {}
+	Relaxed(const Relaxed& r) : value(T(r)) {}
+
+	Relaxed& operator=(const Relaxed& r) { return *this = T(r); }
+	Relaxed& operator=(T v) { value.store(v, std::memory_order_relaxed); return *this; }
+	Relaxed& operator++() { return *this = T(*this) + 1; }
+	operator T() const { return value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<T> value;
+};
+
 struct SearchInfo {
 	int startTime;
 	int stopTime;
@@ -175,26 +226,33 @@ struct SearchInfo {
 	int infinite;
 	Move bestMove;
 
-	long nodes;
+	// Written by the searching thread, read by the others while it runs
+	Relaxed<uint64_t> nodes;
 
 	int quit;
-	int stopped;
+	Relaxed<bool> stopped;
 
 	float fh;
 	float fhf;
+
+	// Lazy SMP: helper threads poll the main thread's info for the stop signal
+	int threadId;
+	SearchInfo* mainInfo;
+	Depth completedDepth;
+	Value bestValue;
 };
 
 // Additional operators to add a Direction to a Square
 constexpr Square operator+(Square s, Direction d) { return Square(int(s) + int(d)); }
 constexpr Square operator-(Square s, Direction d) { return Square(int(s) - int(d)); }
-inline Square& operator+=(Square& s, Direction d) { return s = s + d; }
-inline Square& operator-=(Square& s, Direction d) { return s = s - d; }
+constexpr Square& operator+=(Square& s, Direction d) { return s = s + d; }
+constexpr Square& operator-=(Square& s, Direction d) { return s = s - d; }
 
 // Additional operators to add integers to a Value
 constexpr Value operator+(Value v, int i) { return Value(int(v) + i); }
 constexpr Value operator-(Value v, int i) { return Value(int(v) - i); }
-inline Value& operator+=(Value& v, int i) { return v = v + i; }
-inline Value& operator-=(Value& v, int i) { return v = v - i; }
+constexpr Value& operator+=(Value& v, int i) { return v = v + i; }
+constexpr Value& operator-=(Value& v, int i) { return v = v - i; }
 
 // Additional operators to multiply a Value by Depth, used to calculate depth based margins
 constexpr Value operator*(Value v, Depth d) { return Value(int(v) * int(d)); }
@@ -217,12 +275,12 @@ constexpr File operator~(File f) {
 constexpr T operator+(T d1, T d2) { return T(int(d1) + int(d2)); } \
 constexpr T operator-(T d1, T d2) { return T(int(d1) - int(d2)); } \
 constexpr T operator-(T d) { return T(-int(d)); }                  \
-inline T& operator+=(T& d1, T d2) { return d1 = d1 + d2; }         \
-inline T& operator-=(T& d1, T d2) { return d1 = d1 - d2; }
+constexpr T& operator+=(T& d1, T d2) { return d1 = d1 + d2; }      \
+constexpr T& operator-=(T& d1, T d2) { return d1 = d1 - d2; }
 
 #define ENABLE_INCR_OPERATORS_ON(T)                                \
-inline T& operator++(T& d) { return d = T(int(d) + 1); }           \
-inline T& operator--(T& d) { return d = T(int(d) - 1); }
+constexpr T& operator++(T& d) { return d = T(int(d) + 1); }        \
+constexpr T& operator--(T& d) { return d = T(int(d) - 1); }
 
 #define ENABLE_FULL_OPERATORS_ON(T)                                \
 ENABLE_BASE_OPERATORS_ON(T)                                        \
@@ -231,8 +289,8 @@ constexpr T operator*(int i, T d) { return T(i * int(d)); }        \
 constexpr T operator*(T d, int i) { return T(int(d) * i); }        \
 constexpr T operator/(T d, int i) { return T(int(d) / i); }        \
 constexpr int operator/(T d1, T d2) { return int(d1) / int(d2); }  \
-inline T& operator*=(T& d, int i) { return d = T(int(d) * i); }    \
-inline T& operator/=(T& d, int i) { return d = T(int(d) / i); }
+constexpr T& operator*=(T& d, int i) { return d = T(int(d) * i); } \
+constexpr T& operator/=(T& d, int i) { return d = T(int(d) / i); }
 
 ENABLE_FULL_OPERATORS_ON(Value)
 ENABLE_FULL_OPERATORS_ON(Depth)
@@ -248,6 +306,17 @@ ENABLE_INCR_OPERATORS_ON(Rank)
 ENABLE_INCR_OPERATORS_ON(Phase)
 ENABLE_BASE_OPERATORS_ON(CastlingRight)
 
+// Array is a fixed size array which a constexpr function can fill and return,
+// so that lookup tables are computed by the compiler and stored in the binary
+// instead of being initialized at startup.
+template<typename T, int Size>
+struct Array {
+	T values[Size];
+
+	constexpr T& operator[](int i) { return values[i]; }
+	constexpr const T& operator[](int i) const { return values[i]; }
+};
+
 constexpr bool is_ok(Square s) {
 	return s >= SQ_A1 && s <= SQ_H8;
 }
@@ -261,12 +330,6 @@ constexpr bool is_ok(PieceType pt) {
 		|| pt == KING;
 }
 
-constexpr bool is_ok(Flag fl) {
-	return fl == FLAG_EP
-		|| fl == FLAG_PS
-		|| fl == FLAG_CASTLE;
-}
-
 constexpr File file_of(Square s) {
 	return File(s & 7);
 }
@@ -275,6 +338,22 @@ constexpr Rank rank_of(Square s) {
 	return Rank(s >> 3);
 }
 
+constexpr Rank relative_rank(Color c, Rank r) {
+	return Rank(r ^ (c * 7));
+}
+
+constexpr Rank relative_rank(Color c, Square s) {
+	return relative_rank(c, rank_of(s));
+}
+
+constexpr Square relative_square(Color c, Square s) {
+	return Square(s ^ (c * 56));
+}
+
+constexpr Direction pawn_push(Color c) {
+	return c == WHITE ? NORTH : SOUTH;
+}
+
 constexpr Value mate_in(int ply) {
 	return VALUE_MATE - ply;
 }
@@ -295,27 +374,21 @@ constexpr Square to_sq(Move m) {
 	return Square((m >> 6) & 0x3F);
 }
 
-constexpr PieceType moved_piece(Move m) {
-	return PieceType((m >> 12) & 0x7);
-}
-
-constexpr PieceType captured_piece(Move m) {
-	return PieceType((m >> 15) & 0x7);
+constexpr MoveType type_of(Move m) {
+	return MoveType(m & (3 << 14));
 }
 
 constexpr PieceType promoted_piece(Move m) {
-	return PieceType((m >> 18) & 0x7);
+	return type_of(m) == PROMOTION ? PieceType(((m >> 12) & 3) + KNIGHT) : PIECETYPE_NONE;
 }
 
-constexpr Move make(Square f, Square t, PieceType mo, PieceType ca, PieceType pro, Flag fl) {
-	assert(is_ok(f));
-	assert(is_ok(t));
-	assert(is_ok(mo));
-	assert(is_ok(ca) || ca == PIECETYPE_NONE);
-	assert(is_ok(pro) || pro == PIECETYPE_NONE);
-	assert(is_ok(fl) || fl == FLAG_NONE);
+constexpr Move make_move(Square f, Square t) {
+	return Move(f | (t << 6));
+}
 
-	return Move(f | (t << 6) | (mo << 12) | (ca << 15) | (pro << 18) | fl);
+template<MoveType T>
+constexpr Move make(Square f, Square t, PieceType pt = KNIGHT) {
+	return Move(T | ((pt - KNIGHT) << 12) | (int(t) << 6) | int(f));
 }
 
 #ifdef _WIN64
@@ -326,6 +399,13 @@ inline Square lsb(Bitboard b) {
 	return (Square)idx;
 }
 
+inline Square msb(Bitboard b) {
+	assert(b);
+	unsigned long idx;
+	_BitScanReverse64(&idx, b);
+	return (Square)idx;
+}
+
 #else  // unix
 inline Square lsb(Bitboard b) {
 	assert(b);
@@ -333,6 +413,11 @@ inline Square lsb(Bitboard b) {
 	idx = __builtin_ffsll(b) - 1;
 	return (Square)idx;
 }
+
+inline Square msb(Bitboard b) {
+	assert(b);
+	return Square(63 ^ __builtin_clzll(b));
+}
 #endif
 
 inline Square pop_lsb(Bitboard* b) {
@@ -341,14 +426,52 @@ inline Square pop_lsb(Bitboard* b) {
 	return s;
 }
 
-inline int popcount(Bitboard b) {
+// popcount_software() counts the set bits without the POPCNT instruction
+inline int popcount_software(Bitboard b) {
+	b = b - ((b >> 1) & 0x5555555555555555ULL);
+	b = (b & 0x3333333333333333ULL) + ((b >> 2) & 0x3333333333333333ULL);
+	b = (b + (b >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return int((b * 0x0101010101010101ULL) >> 56);
+}
+
+// popcount_hardware() counts the set bits with POPCNT. It must only be called
+// if CPU::HasPopcnt is set, compilers that need the instruction enabled get it
+// for this function alone, as for pext() below.
+#if defined(__GNUC__) && !defined(__POPCNT__)
+__attribute__((target("popcnt")))
+#endif
+inline int popcount_hardware(Bitboard b) {
 #if defined(_MSC_VER) || defined(__INTEL_COMPILER)
 	return (int)_mm_popcnt_u64(b);
-#else // Assumed gcc or compatible compiler
+#else
 	return __builtin_popcountll(b);
 #endif
 }
 
+// popcount() picks the instruction at runtime, unless the build already
+// targets processors which have it
+inline int popcount(Bitboard b) {
+#if defined(__POPCNT__)
+	return popcount_hardware(b);
+#else
+	return CPU::HasPopcnt ? popcount_hardware(b) : popcount_software(b);
+#endif
+}
+
+// pext() must only be called if CPU::HasBmi2 is set. Compilers that need it
+// enabled to emit the instruction get it for this function alone.
+#if defined(__GNUC__) && !defined(__BMI2__)
+__attribute__((target("bmi2")))
+#endif
 inline unsigned int pext(Bitboard b, Bitboard m) {
 	return unsigned(_pext_u64(b, m));
+}
+
+// pdep() deposits the low bits of b on the set bits of m. The same rules as
+// for pext() apply.
+#if defined(__GNUC__) && !defined(__BMI2__)
+__attribute__((target("bmi2")))
+#endif
+inline Bitboard pdep(Bitboard b, Bitboard m) {
+	return _pdep_u64(b, m);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "perft.h"
 #include "typeconvertions.h"
 #include "../movegen.h"
+#include "../searchcontext.h"
 
 namespace Perft {
 
@@ -13,16 +14,21 @@ namespace Perft {
 			return;
 		}
 
-		Movelist list = Movelist();
+		Movelist& list = pos.context().move_list(pos.ply());
+		list.count = 0;
 		Movegen::get_moves(pos, list);
 
+		// Bulk counting, the move generator emits legal moves only
+		if (depth == 1) {
+			leafNodes += list.count;
+			return;
+		}
+
 		int moveNum = 0;
 		for (moveNum = 0; moveNum < list.count; ++moveNum) {
 			Move move = list.moves[moveNum].move;
 			
-			if (!pos.do_move(move))
-				continue;
-			
+			pos.do_move(move);
 			perft(pos, depth - 1, leafNodes);
 			
 			pos.undo_move();
@@ -32,7 +38,8 @@ namespace Perft {
 	unsigned long long perft_begin(Position& pos, int depth, bool print) {
 		std::clock_t start = std::clock();
 		unsigned long long leafNodes = 0;
-		Movelist list = Movelist();
+		Movelist& list = pos.context().move_list(pos.ply());
+		list.count = 0;
 
 		depth = depth <= 0 ? 1 : depth;
 		Movegen::get_moves(pos, list);
@@ -41,8 +48,7 @@ namespace Perft {
 		for (int moveNum = 0; moveNum < list.count; ++moveNum) {
 			move = list.moves[moveNum].move;
 
-			if (!pos.do_move(move))
-				continue;
+			pos.do_move(move);
 
 			unsigned long long cumnodes = leafNodes;
 			perft(pos, depth - 1, leafNodes);
@@ -62,7 +68,13 @@ namespace Perft {
 		return leafNodes;
 	}
 
-	void perft_auto(Position& pos, int maxDepth) {
+	// Perft::perft_auto() checks the move generator on positions with known
+	// node counts. It plays on a board of its own, so that the board of the
+	// interface is left as it was.
+	void perft_auto(int maxDepth) {
+		SearchContext ctx;
+		Position pos(ctx);
+
 		maxDepth = maxDepth <= 0 ? 6 : maxDepth;
 		std::string fens[3] = { 
 			"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1" ,
@@ -5,5 +5,5 @@
 
 namespace Perft {
 	unsigned long long perft_begin(Position& pos, int depth, bool print);
-	void perft_auto(Position& pos, int maxDepth);
+	void perft_auto(int maxDepth);
 }